@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "core/type.hpp"
+#include "core/atomic.hpp"
+#include "core/bigvector.hpp"
+#include "core/threadpool.hpp"
+
+// per-worker partial sums for targets that several threads update at once (e.g. update_mode 1 with
+// fewer columns than threads); add() is a plain store and flush() folds the partial sums into the target
+// vector. if the partial sums would not fit into budget_bytes, add() falls back to write_add on the target.
+template <typename T>
+class Accumulator {
+	BigVector<T> & target;
+	int threads;
+	size_t length;
+	T ** local;
+public:
+	Accumulator(BigVector<T> & target, int threads, long budget_bytes) : target(target), threads(threads) {
+		length = target.length;
+		local = NULL;
+		if ((long)(sizeof(T) * length * threads) <= budget_bytes) {
+			local = new T * [threads];
+			for (int i=0;i<threads;i++) {
+				local[i] = NULL;
+			}
+		}
+	}
+	~Accumulator() {
+		if (local!=NULL) {
+			for (int i=0;i<threads;i++) {
+				free(local[i]);
+			}
+			delete [] local;
+		}
+	}
+	bool is_local() {
+		return local!=NULL;
+	}
+	void add(VertexId i, T value) {
+		int thread_id = worker_id();
+		if (local==NULL || thread_id < 0) {
+			write_add(&target[i], value);
+			return;
+		}
+		T * slab = local[thread_id];
+		if (slab==NULL) {
+			slab = (T *)calloc(length, sizeof(T));
+			assert(slab!=NULL);
+			local[thread_id] = slab;
+		}
+		slab[i] += value;
+	}
+	// target[i] += partial sums of every worker, then reset the partial sums
+	void flush() {
+		if (local==NULL) return;
+		#pragma omp parallel for
+		for (size_t i=0;i<length;i++) {
+			T value = 0;
+			for (int t=0;t<threads;t++) {
+				if (local[t]!=NULL) {
+					value += local[t][i];
+					local[t][i] = 0;
+				}
+			}
+			if (value!=0) {
+				target[i] += value;
+			}
+		}
+		#pragma omp barrier
+	}
+};
+
+#endif
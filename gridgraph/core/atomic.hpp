@@ -21,8 +21,12 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include <stdlib.h>
 #include <assert.h>
 
+// the value arguments take the type of the pointee, so literals and VertexId mix freely
+template <class T>
+struct atomic_value { typedef T type; };
+
 template <class ET>
-inline bool cas(ET *ptr, ET oldv, ET newv) {
+inline bool cas(ET *ptr, typename atomic_value<ET>::type oldv, typename atomic_value<ET>::type newv) {
 	if (sizeof(ET) == 8) {
 		return __sync_bool_compare_and_swap((long*)ptr, *((long*)&oldv), *((long*)&newv));
 	} else if (sizeof(ET) == 4) {
@@ -33,7 +37,7 @@ inline bool cas(ET *ptr, ET oldv, ET newv) {
 }
 
 template <class ET>
-inline bool write_min(ET *a, ET b) {
+inline bool write_min(ET *a, typename atomic_value<ET>::type b) {
 	ET c; bool r=0;
 	do c = *a;
 	while (c > b && !(r=cas(a,c,b)));
@@ -41,7 +45,7 @@ inline bool write_min(ET *a, ET b) {
 }
 
 template <class ET>
-inline void write_add(ET *a, ET b) {
+inline void write_add(ET *a, typename atomic_value<ET>::type b) {
 	volatile ET newV, oldV;
 	do {oldV = *a; newV = oldV + b;}
 	while (!cas(a, oldV, newV));
@@ -24,18 +24,119 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include <omp.h>
 
 #include <thread>
+#include <vector>
 
 #include "core/filesystem.hpp"
 #include "core/partition.hpp"
+#include "core/numa.hpp"
+
+// placement of vectors held in anonymous memory (see BigVector::init with memory flags)
+#define MEMORY_HUGE_PAGES 1 // transparent huge pages
+#define MEMORY_HUGETLB 2 // explicit huge pages from the reserved pool, transparent ones when it is empty
+#define MEMORY_INTERLEAVE 4 // pages round-robin over the NUMA nodes
+
+#define HUGE_PAGESIZE (2l << 20)
+
+// anonymous memory placed according to memory flags; returns the mapped bytes in mapped_bytes
+inline void * map_memory(size_t bytes, int memory_flags, size_t & mapped_bytes) {
+	void * addr = MAP_FAILED;
+	if (memory_flags & MEMORY_HUGETLB) {
+		mapped_bytes = (bytes + HUGE_PAGESIZE - 1) / HUGE_PAGESIZE * HUGE_PAGESIZE;
+		addr = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (addr==MAP_FAILED) {
+			memory_flags |= MEMORY_HUGE_PAGES;
+		}
+	}
+	if (addr==MAP_FAILED) {
+		mapped_bytes = (bytes + 4095) / 4096 * 4096;
+		addr = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(addr!=MAP_FAILED);
+		if (memory_flags & MEMORY_HUGE_PAGES) {
+			madvise(addr, mapped_bytes, MADV_HUGEPAGE); // only a hint; fails harmlessly when THP is off
+		}
+	}
+	if (memory_flags & MEMORY_INTERLEAVE) {
+		numa_interleave(addr, mapped_bytes);
+	}
+	return addr;
+}
+
+// the window operations Graph uses to pipeline the vectors passed to hint()
+class BigVectorBase {
+public:
+	virtual ~BigVectorBase() {}
+	// whether a window is held in memory (by load)
+	virtual bool window_loaded() = 0;
+	// start reading a window that a later load of the same range picks up
+	virtual void prefetch(size_t begin_i, size_t end_i) = 0;
+	// in async mode save writes the window back in the background; leaving it waits for all pending I/O
+	virtual void set_async_io(bool async_io) = 0;
+};
 
 template <typename T>
-class BigVector {
+class BigVector : public BigVectorBase {
 	std::string path;
 	bool is_open;
 	bool in_memory = false;
 	size_t begin_i = 0, end_i = 0;
 	T * data_in_memory = NULL;
+	size_t loaded_bytes = 0;
 	static const long PAGESIZE = 4096;
+	// anonymous vectors live in memory as a whole: load and save do nothing, and a file (if any) is read
+	// at init and written back by sync and on destruction
+	bool anonymous = false;
+	int memory_flags = 0;
+	size_t mapped_bytes = 0;
+	// asynchronous windows: at most one prefetched window and one window being written back
+	bool async_io = false;
+	size_t prefetch_begin_i = 0, prefetch_end_i = 0;
+	T * prefetch_data = NULL;
+	size_t prefetch_bytes = 0;
+	std::thread prefetch_thread;
+	std::thread writeback_thread;
+	size_t writeback_end_i = 0;
+
+	void read_range(T * buffer, size_t begin_i, size_t end_i) {
+		long end_offset = end_i * sizeof(T);
+		long offset = begin_i * sizeof(T);
+		long bytes;
+		while (offset < end_offset) {
+			bytes = pread(fd, buffer + (offset / sizeof(T) - begin_i), (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE, offset);
+			if (bytes==-1) {
+				printf("%ld %ld\n", offset, end_offset);
+				printf("%s\n", strerror(errno));
+				getchar();
+				exit(-1);
+			}
+			offset += bytes;
+		}
+	}
+	void write_range(T * buffer, size_t begin_i, size_t end_i) {
+		long end_offset = end_i * sizeof(T);
+		long offset = begin_i * sizeof(T);
+		long bytes;
+		while (offset < end_offset) {
+			bytes = pwrite(fd, buffer + (offset / sizeof(T) - begin_i), (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE, offset);
+			if (bytes==-1) {
+				printf("%ld %ld\n", offset, end_offset);
+				printf("%s\n", strerror(errno));
+				getchar();
+				exit(-1);
+			}
+			offset += bytes;
+		}
+	}
+	void discard_prefetch() {
+		if (prefetch_thread.joinable()) prefetch_thread.join();
+		if (prefetch_data!=NULL) {
+			int ret = munmap(prefetch_data, prefetch_bytes);
+			assert(ret==0);
+			prefetch_data = NULL;
+		}
+	}
+	void wait_writeback() {
+		if (writeback_thread.joinable()) writeback_thread.join();
+	}
 public:
 	int fd;
 	T * data;
@@ -44,6 +145,7 @@ public:
 		is_open = false;
 		data = NULL;
 		length = 0;
+		fd = -1;
 	}
 	BigVector(std::string path, size_t length) {
 		init(path, length);
@@ -51,8 +153,24 @@ public:
 	BigVector(std::string path) {
 		init(path);
 	}
+	BigVector(std::string path, size_t length, int memory_flags) {
+		init(path, length, memory_flags);
+	}
+	// a scratch vector without file backing
+	BigVector(size_t length, int memory_flags) {
+		init(length, memory_flags);
+	}
 	~BigVector() {
-		if (is_open && file_exists(path)) {
+		discard_prefetch();
+		wait_writeback();
+		if (anonymous && is_open) {
+			if (fd!=-1) {
+				sync();
+				close(fd);
+			}
+			int ret = munmap(data, mapped_bytes);
+			assert(ret==0);
+		} else if (is_open && file_exists(path)) {
 			close_mmap();
 		}
 	}
@@ -89,6 +207,50 @@ public:
 		assert(fd!=-1);
 		open_mmap();
 	}
+	// the file is copied into anonymous memory placed by memory_flags instead of being mapped
+	void init(std::string path, size_t length, int memory_flags) {
+		init(path, length);
+		close_mmap();
+		close(fd);
+		fd = open(path.c_str(), O_RDWR);
+		assert(fd!=-1);
+		open_memory(length, memory_flags);
+		long file_length = sizeof(T) * length;
+		for (long offset=0;offset<file_length;) {
+			long bytes = pread(fd, (char *)data + offset, file_length - offset, offset);
+			assert(bytes>0);
+			offset += bytes;
+		}
+	}
+	void init(size_t length, int memory_flags) {
+		this->path = "";
+		this->length = length;
+		fd = -1;
+		open_memory(length, memory_flags);
+	}
+	void open_memory(size_t length, int memory_flags) {
+		anonymous = true;
+		this->memory_flags = memory_flags;
+		data = (T *)map_memory(sizeof(T) * length, memory_flags, mapped_bytes);
+		is_open = true;
+	}
+	// for file mapped vectors, the placement of the copies made by load
+	void set_memory_flags(int memory_flags) {
+		this->memory_flags = memory_flags;
+	}
+	// prefer the node of each partition's vertex range (see partition_node)
+	void place(int partitions) {
+		assert(anonymous);
+		int nodes = numa_nodes();
+		if (nodes<=1) return;
+		for (int p=0;p<partitions;p++) {
+			size_t begin, end;
+			std::tie(begin, end) = get_partition_range(length, partitions, p);
+			size_t begin_byte = begin * sizeof(T) / PAGESIZE * PAGESIZE;
+			size_t end_byte = std::min((end * sizeof(T) + PAGESIZE - 1) / PAGESIZE * PAGESIZE, mapped_bytes);
+			numa_prefer((char *)data + begin_byte, end_byte - begin_byte, partition_node(p, partitions, nodes));
+		}
+	}
 	void open_mmap() {
 		int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 		assert(ret==0);
@@ -125,6 +287,16 @@ public:
 		}
 	}
 	void sync() {
+		if (anonymous) {
+			if (fd==-1) return;
+			long file_length = sizeof(T) * length;
+			for (long offset=0;offset<file_length;) {
+				long bytes = pwrite(fd, (char *)data + offset, file_length - offset, offset);
+				assert(bytes>0);
+				offset += bytes;
+			}
+			return;
+		}
 		assert(msync(data, sizeof(T) * length, MS_SYNC)==0);
 	}
 	void lock(size_t begin_i, size_t end_i) {
@@ -134,50 +306,90 @@ public:
 		assert(munlock(data + begin_i, (end_i - begin_i) * sizeof(T))==0);
 	}
 	void load(size_t begin_i, size_t end_i) {
-		close_mmap();
+		if (anonymous) return;
+		if (is_open) close_mmap();
 		begin_i = begin_i * sizeof(T) / PAGESIZE * PAGESIZE / sizeof(T);
 		this->begin_i = begin_i;
 		this->end_i = end_i;
 		in_memory = true;
+		if (prefetch_data!=NULL && prefetch_begin_i==begin_i && prefetch_end_i==end_i) {
+			if (prefetch_thread.joinable()) prefetch_thread.join();
+			data_in_memory = prefetch_data;
+			loaded_bytes = prefetch_bytes;
+			prefetch_data = NULL;
+			return;
+		}
+		discard_prefetch();
+		wait_writeback();
 		// data_in_memory = (T *)memalign(PAGESIZE, (end_i - begin_i) * sizeof(T) + PAGESIZE);
 		// assert(data_in_memory!=NULL);
-		data_in_memory = (T *)mmap(0, (end_i - begin_i) * sizeof(T) + PAGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		assert(data_in_memory!=MAP_FAILED);
-		long end_offset = end_i * sizeof(T);
-		long offset = begin_i * sizeof(T);
-		long bytes;
-		while (offset < end_offset) {
-			bytes = pread(fd, data_in_memory + (offset / sizeof(T) - begin_i), (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE, offset);
-			if (bytes==-1) {
-				printf("%ld %ld\n", offset, end_offset);
-				printf("%s\n", strerror(errno));
-				getchar();
-				exit(-1);
-			}
-			offset += bytes;
-		}
+		data_in_memory = (T *)map_memory((end_i - begin_i) * sizeof(T) + PAGESIZE, memory_flags, loaded_bytes);
+		read_range(data_in_memory, begin_i, end_i);
 	}
 	void save() {
-		long end_offset = end_i * sizeof(T);
-		long offset = begin_i * sizeof(T);
-		long bytes;
-		while (offset < end_offset) {
-			bytes = pwrite(fd, data_in_memory + (offset / sizeof(T) - begin_i), (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE, offset);
-			if (bytes==-1) {
-				printf("%ld %ld\n", offset, end_offset);
-				printf("%s\n", strerror(errno));
-				getchar();
-				exit(-1);
+		if (anonymous) return;
+		if (async_io) {
+			// windows may share their boundary page: the prefetched window takes this window's part of it, and
+			// one write back at a time keeps the later window's copy of the page the one that lands last
+			wait_writeback();
+			if (prefetch_data!=NULL) {
+				if (prefetch_thread.joinable()) prefetch_thread.join();
+				for (size_t i=std::max(begin_i, prefetch_begin_i);i<std::min(end_i, prefetch_end_i);i++) {
+					prefetch_data[i - prefetch_begin_i] = data_in_memory[i - begin_i];
+				}
 			}
-			offset += bytes;
+			T * buffer = data_in_memory;
+			size_t buffer_bytes = loaded_bytes;
+			size_t buffer_begin_i = begin_i, buffer_end_i = end_i;
+			writeback_end_i = end_i;
+			writeback_thread = std::thread([this, buffer, buffer_bytes, buffer_begin_i, buffer_end_i](){
+				write_range(buffer, buffer_begin_i, buffer_end_i);
+				int ret = munmap(buffer, buffer_bytes);
+				assert(ret==0);
+			});
+			in_memory = false;
+			begin_i = 0;
+			end_i = 0;
+			return; // the mapping is restored by set_async_io(false)
 		}
-		int ret = munmap(data_in_memory, (end_i - begin_i) * sizeof(T) + PAGESIZE);
+		write_range(data_in_memory, begin_i, end_i);
+		int ret = munmap(data_in_memory, loaded_bytes);
 		assert(ret==0);
 		in_memory = false;
 		begin_i = 0;
 		end_i = 0;
 		open_mmap();
 	}
+	// the file holding the data once sync() returns, "" for vectors kept in anonymous memory
+	std::string backing_file() {
+		return anonymous ? "" : path;
+	}
+	bool window_loaded() {
+		return in_memory;
+	}
+	void prefetch(size_t begin_i, size_t end_i) {
+		if (anonymous) return;
+		discard_prefetch();
+		begin_i = begin_i * sizeof(T) / PAGESIZE * PAGESIZE / sizeof(T);
+		if (writeback_thread.joinable() && (writeback_end_i * sizeof(T) + PAGESIZE - 1) / PAGESIZE * PAGESIZE > begin_i * sizeof(T)) {
+			wait_writeback(); // a window smaller than a page: the last one written shares a page with this one
+		}
+		prefetch_begin_i = begin_i;
+		prefetch_end_i = end_i;
+		prefetch_data = (T *)map_memory((end_i - begin_i) * sizeof(T) + PAGESIZE, memory_flags, prefetch_bytes);
+		T * buffer = prefetch_data;
+		prefetch_thread = std::thread([this, buffer, begin_i, end_i](){
+			read_range(buffer, begin_i, end_i);
+		});
+	}
+	void set_async_io(bool async_io) {
+		if (!async_io) {
+			discard_prefetch();
+			wait_writeback();
+			if (!anonymous && !is_open && !in_memory) open_mmap();
+		}
+		this->async_io = async_io;
+	}
 };
 
 #endif
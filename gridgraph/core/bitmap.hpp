@@ -17,29 +17,56 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #ifndef BITMAP_H
 #define BITMAP_H
 
+#include <algorithm>
+
 #define WORD_OFFSET(i) (i >> 6)
 #define BIT_OFFSET(i) (i & 0x3f)
 
+// one summary bit covers 64 words (4096 vertices)
+#define GROUP_SHIFT 12
+#define GROUP_OFFSET(i) (i >> GROUP_SHIFT)
+
 class Bitmap {
 public:
 	size_t size;
 	unsigned long * data;
+	unsigned long * summary; // bit g is set whenever a bit of group g may be set
 	Bitmap() {
 		size = 0;
 		data = NULL;
+		summary = NULL;
 	}
 	Bitmap(size_t size) {
 		init(size);
 	}
+	~Bitmap() {
+		delete [] data;
+		delete [] summary;
+	}
 	void init(size_t size) {
 		this->size = size;
-		data = new unsigned long [WORD_OFFSET(size)+1];
+		data = new unsigned long [WORD_OFFSET(size)+1]();
+		summary = new unsigned long [WORD_OFFSET(GROUP_OFFSET(size))+1]();
+	}
+	size_t groups() {
+		return GROUP_OFFSET(size) + 1;
 	}
+	// only the words of groups marked in the summary can be non-zero
 	void clear() {
 		size_t bm_size = WORD_OFFSET(size);
+		size_t summary_size = WORD_OFFSET(GROUP_OFFSET(size));
 		#pragma omp parallel for
-		for (size_t i=0;i<=bm_size;i++) {
-			data[i] = 0;
+		for (size_t s=0;s<=summary_size;s++) {
+			unsigned long word = summary[s];
+			while (word!=0) {
+				size_t group = (s << 6) + __builtin_ctzl(word);
+				size_t end_i = std::min((group + 1) << (GROUP_SHIFT - 6), bm_size + 1);
+				for (size_t i=group<<(GROUP_SHIFT - 6);i<end_i;i++) {
+					data[i] = 0;
+				}
+				word &= word - 1;
+			}
+			summary[s] = 0;
 		}
 		#pragma omp barrier
 	}
@@ -54,12 +81,72 @@ public:
 		for (size_t i=(bm_size<<6);i<size;i++) {
 			data[bm_size] |= 1ul << BIT_OFFSET(i);
 		}
+		size_t summary_size = WORD_OFFSET(GROUP_OFFSET(size));
+		for (size_t s=0;s<=summary_size;s++) {
+			summary[s] = 0;
+		}
+		for (size_t group=0;group<groups();group++) {
+			summary[WORD_OFFSET(group)] |= 1ul << BIT_OFFSET(group);
+		}
 	}
 	unsigned long get_bit(size_t i) {
 		return data[WORD_OFFSET(i)] & (1ul<<BIT_OFFSET(i));
 	}
+	unsigned long get_group(size_t group) {
+		return summary[WORD_OFFSET(group)] & (1ul<<BIT_OFFSET(group));
+	}
 	void set_bit(size_t i) {
 		__sync_fetch_and_or(data+WORD_OFFSET(i), 1ul<<BIT_OFFSET(i));
+		size_t group = GROUP_OFFSET(i);
+		if (!get_group(group)) {
+			__sync_fetch_and_or(summary+WORD_OFFSET(group), 1ul<<BIT_OFFSET(group));
+		}
+	}
+	// set bit i; returns whether it was already set
+	bool test_and_set_bit(size_t i) {
+		unsigned long mask = 1ul<<BIT_OFFSET(i);
+		if (data[WORD_OFFSET(i)] & mask) return true;
+		unsigned long old = __sync_fetch_and_or(data+WORD_OFFSET(i), mask);
+		size_t group = GROUP_OFFSET(i);
+		if (!get_group(group)) {
+			__sync_fetch_and_or(summary+WORD_OFFSET(group), 1ul<<BIT_OFFSET(group));
+		}
+		return (old & mask)!=0;
+	}
+	// the summary is left as is: it may over-approximate
+	void clear_bit(size_t i) {
+		__sync_fetch_and_and(data+WORD_OFFSET(i), ~(1ul<<BIT_OFFSET(i)));
+	}
+	// the number of set bits, skipping empty groups
+	size_t count() {
+		size_t bm_size = WORD_OFFSET(size);
+		size_t total = 0;
+		#pragma omp parallel for reduction(+:total)
+		for (size_t group=0;group<groups();group++) {
+			if (!get_group(group)) continue;
+			size_t end_i = std::min((group + 1) << (GROUP_SHIFT - 6), bm_size + 1);
+			for (size_t i=group<<(GROUP_SHIFT - 6);i<end_i;i++) {
+				total += __builtin_popcountl(data[i]);
+			}
+		}
+		return total;
+	}
+	// whether any bit in [begin_i, end_i) is set, skipping empty groups through the summary
+	bool any(size_t begin_i, size_t end_i) {
+		size_t i = begin_i;
+		while (i<end_i) {
+			if (!get_group(GROUP_OFFSET(i))) {
+				i = (GROUP_OFFSET(i) + 1) << GROUP_SHIFT;
+				continue;
+			}
+			unsigned long word = data[WORD_OFFSET(i)] >> BIT_OFFSET(i);
+			if (end_i - i < 64) {
+				word &= (1ul << (end_i - i)) - 1;
+			}
+			if (word!=0) return true;
+			i = (WORD_OFFSET(i) + 1) << 6;
+		}
+		return false;
 	}
 };
 
@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+// edge chunks kept in process memory across streaming calls, keyed by (layout, offset, length).
+// every chunk ever requested keeps an access count; a chunk that does not fit is admitted only by evicting
+// chunks accessed strictly fewer times. a cyclic scan of a grid larger than the cache thus keeps the chunks
+// that were admitted first instead of flushing the cache on every pass, as LRU would.
+// chunks are mlocked so that a hit never pages in; a chunk that RLIMIT_MEMLOCK refuses is kept unpinned and
+// counted in unpinned_bytes().
+class EdgeCache {
+	typedef std::tuple<int, long, long> Key;
+	struct Chunk {
+		char * data; // NULL while not resident
+		long bytes;
+		long accesses;
+		int users;
+		bool pinned;
+	};
+	std::mutex mutex;
+	std::map<Key, Chunk> chunks;
+	long capacity;
+	long used;
+	long unpinned; // bytes of resident chunks that could not be mlocked
+
+	void allocate(Chunk & chunk, long bytes) {
+		chunk.data = (char *)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(chunk.data!=MAP_FAILED);
+		chunk.bytes = bytes;
+		chunk.pinned = mlock(chunk.data, bytes)==0;
+		if (!chunk.pinned) unpinned += bytes;
+		used += bytes;
+	}
+
+	void deallocate(Chunk & chunk) {
+		munmap(chunk.data, chunk.bytes); // also unlocks
+		if (!chunk.pinned) unpinned -= chunk.bytes;
+		used -= chunk.bytes;
+		chunk.data = NULL;
+	}
+public:
+	EdgeCache(long capacity) : capacity(capacity), used(0), unpinned(0) {
+	}
+	~EdgeCache() {
+		for (auto & chunk : chunks) {
+			if (chunk.second.data!=NULL) deallocate(chunk.second);
+		}
+	}
+
+	// count an access to a chunk; returns its data, which stays resident until release(), or NULL
+	char * acquire(int layout, long offset, long length, long & bytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+		Chunk & chunk = chunks.emplace(Key(layout, offset, length), Chunk{NULL, 0, 0, 0, false}).first->second;
+		chunk.accesses++;
+		if (chunk.data==NULL) return NULL;
+		chunk.users++;
+		bytes = chunk.bytes;
+		return chunk.data;
+	}
+
+	void release(int layout, long offset, long length) {
+		std::lock_guard<std::mutex> lock(mutex);
+		chunks[Key(layout, offset, length)].users--;
+	}
+
+	// offer a chunk that missed and has just been read
+	void admit(int layout, long offset, long length, const char * data, long bytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (bytes > capacity) return;
+		Chunk & chunk = chunks[Key(layout, offset, length)];
+		if (chunk.data!=NULL) return;
+		if (used + bytes > capacity) {
+			std::vector<std::pair<long, Chunk *> > victims;
+			for (auto & other : chunks) {
+				Chunk & resident = other.second;
+				if (resident.data!=NULL && resident.users==0 && resident.accesses < chunk.accesses) {
+					victims.push_back(std::make_pair(resident.accesses, &resident));
+				}
+			}
+			std::sort(victims.begin(), victims.end(), [](const std::pair<long, Chunk *> & a, const std::pair<long, Chunk *> & b){
+				return a.first < b.first;
+			});
+			long freed = 0;
+			size_t count = 0;
+			while (count < victims.size() && used - freed + bytes > capacity) {
+				freed += victims[count++].second->bytes;
+			}
+			if (used - freed + bytes > capacity) return;
+			for (size_t k=0;k<count;k++) {
+				deallocate(*victims[k].second);
+			}
+		}
+		allocate(chunk, bytes);
+		memcpy(chunk.data, data, bytes);
+	}
+
+	// bytes of resident chunks
+	long size() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return used;
+	}
+
+	// bytes of resident chunks that are not pinned in memory
+	long unpinned_bytes() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return unpinned;
+	}
+};
+
+#endif
@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+
+#include "core/filesystem.hpp"
+#include "core/bitmap.hpp"
+#include "core/frontier.hpp"
+#include "core/bigvector.hpp"
+
+// the state of an iterative algorithm, saved every interval iterations into [dir]/[iteration]/ and committed by
+// renaming [dir]/latest, so a crash leaves the last complete checkpoint in place. a file-mapped vector is synced
+// and cloned (a reflink on copy-on-write file systems, so no data is copied) or else copied file to file in the
+// kernel, so it never passes through process memory; everything else is copied in memory, and the copies are
+// written by a background thread while the next iterations run.
+class Checkpoint {
+	struct Entry {
+		std::string name;
+		std::function<char *()> address; // vectors move when their windows are loaded and saved
+		long bytes;
+		std::function<std::string()> file; // a file to clone instead of copying, or ""
+		std::function<void()> sync;
+		std::function<void()> restored;
+	};
+	std::string dir;
+	int interval;
+	std::vector<Entry> entries;
+	std::thread writer;
+	std::vector<char *> copies;
+
+	void write_file(std::string filename, const char * data, long bytes) {
+		int fout = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		assert(fout!=-1);
+		for (long offset=0;offset<bytes;) {
+			long written = pwrite(fout, data + offset, bytes - offset, offset);
+			assert(written>0);
+			offset += written;
+		}
+		fsync(fout);
+		close(fout);
+	}
+
+	// an instant copy sharing the extents of source, where the file system supports it
+	bool clone_file(std::string source, std::string filename) {
+#ifdef FICLONE
+		int fin = open(source.c_str(), O_RDONLY);
+		int fout = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		assert(fin!=-1 && fout!=-1);
+		bool cloned = ioctl(fout, FICLONE, fin)==0;
+		if (cloned) fsync(fout);
+		close(fout);
+		close(fin);
+		if (!cloned) unlink(filename.c_str()); // a resume must never find a partial file
+		return cloned;
+#else
+		return false;
+#endif
+	}
+
+	// the first bytes of source, copied by the kernel: copy_file_range, or sendfile where that is not available
+	void copy_file(std::string source, std::string filename, long bytes) {
+		int fin = open(source.c_str(), O_RDONLY);
+		int fout = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		assert(fin!=-1 && fout!=-1);
+		loff_t in_offset = 0, out_offset = 0;
+		while (in_offset < bytes) {
+			long copied = copy_file_range(fin, &in_offset, fout, &out_offset, bytes - in_offset, 0);
+			if (copied<=0) break;
+		}
+		lseek(fout, out_offset, SEEK_SET); // sendfile writes at the file position
+		while (in_offset < bytes) {
+			off_t offset = in_offset;
+			long copied = sendfile(fout, fin, &offset, bytes - in_offset);
+			assert(copied>0);
+			in_offset = offset;
+		}
+		fsync(fout);
+		close(fout);
+		close(fin);
+	}
+
+	int latest() {
+		FILE * fin = fopen((dir+"/latest").c_str(), "r");
+		if (fin==NULL) return 0;
+		int iteration = 0;
+		int fields = fscanf(fin, "%d", &iteration);
+		assert(fields==1);
+		fclose(fin);
+		return iteration;
+	}
+public:
+	// interval = 0 disables saving
+	Checkpoint(std::string dir, int interval) : dir(dir), interval(interval) {
+	}
+	~Checkpoint() {
+		wait();
+	}
+
+	template <typename T>
+	void add(std::string name, BigVector<T> & vector) {
+		entries.push_back(Entry{name, [&vector](){ return (char *)vector.data; }, (long)(sizeof(T) * vector.length),
+			[&vector](){ return vector.backing_file(); }, [&vector](){ vector.sync(); }, [](){}});
+	}
+
+	void add(std::string name, Bitmap & bitmap) {
+		entries.push_back(Entry{name, [&bitmap](){ return (char *)bitmap.data; }, (long)(sizeof(unsigned long) * (WORD_OFFSET(bitmap.size)+1)),
+			[](){ return std::string(""); }, [](){}, [](){}});
+		entries.push_back(Entry{name+".summary", [&bitmap](){ return (char *)bitmap.summary; }, (long)(sizeof(unsigned long) * (WORD_OFFSET(GROUP_OFFSET(bitmap.size))+1)),
+			[](){ return std::string(""); }, [](){}, [](){}});
+	}
+
+	// the frontier the variable points to at save time (algorithms swap their frontiers)
+	void add(std::string name, Frontier * & frontier) {
+		entries.push_back(Entry{name, [&frontier](){ return (char *)frontier->bitmap.data; }, (long)(sizeof(unsigned long) * (WORD_OFFSET(frontier->bitmap.size)+1)),
+			[](){ return std::string(""); }, [](){}, [](){}});
+		entries.push_back(Entry{name+".summary", [&frontier](){ return (char *)frontier->bitmap.summary; }, (long)(sizeof(unsigned long) * (WORD_OFFSET(GROUP_OFFSET(frontier->bitmap.size))+1)),
+			[](){ return std::string(""); }, [](){}, [&frontier](){ frontier->set_dense(); }});
+	}
+
+	// a plain value such as a counter or a running total
+	template <typename T>
+	void add(std::string name, T & value) {
+		entries.push_back(Entry{name, [&value](){ return (char *)&value; }, (long)sizeof(T),
+			[](){ return std::string(""); }, [](){}, [](){}});
+	}
+
+	// restore the registered state from the last complete checkpoint; returns its iteration, 0 if there is none
+	int resume() {
+		int iteration = latest();
+		if (iteration==0) return 0;
+		std::string path = dir + "/" + std::to_string(iteration) + "/";
+		for (auto & entry : entries) {
+			std::string filename = path + entry.name;
+			if (!file_exists(filename) || file_size(filename)!=entry.bytes) {
+				fprintf(stderr, "%s does not match this run (%s)\n", path.c_str(), entry.name.c_str());
+				exit(-1);
+			}
+			int fin = open(filename.c_str(), O_RDONLY);
+			assert(fin!=-1);
+			char * data = entry.address();
+			for (long offset=0;offset<entry.bytes;) {
+				long bytes = pread(fin, data + offset, entry.bytes - offset, offset);
+				assert(bytes>0);
+				offset += bytes;
+			}
+			close(fin);
+			entry.restored();
+		}
+		return iteration;
+	}
+
+	// checkpoint after iteration if it is a multiple of the interval; the state must not change during the call.
+	// returns whether a checkpoint was started
+	bool save(int iteration) {
+		if (interval<=0 || iteration % interval!=0) return false;
+		wait();
+		create_directory(dir);
+		std::string path = dir + "/" + std::to_string(iteration);
+		if (file_exists(path)) {
+			remove_directory(path);
+		}
+		create_directory(path);
+		std::vector<std::pair<std::string, long> > pending;
+		for (auto & entry : entries) {
+			std::string file = entry.file();
+			if (file!="") {
+				// copied before returning: the next iterations write to the file
+				entry.sync();
+				if (!clone_file(file, path + "/" + entry.name)) {
+					copy_file(file, path + "/" + entry.name, entry.bytes);
+				}
+				continue;
+			}
+			char * copy = (char *)malloc(entry.bytes);
+			assert(copy!=NULL);
+			memcpy(copy, entry.address(), entry.bytes);
+			copies.push_back(copy);
+			pending.push_back(std::make_pair(entry.name, entry.bytes));
+		}
+		int previous = latest();
+		writer = std::thread([this, path, pending, iteration, previous](){
+			for (size_t k=0;k<pending.size();k++) {
+				write_file(path + "/" + pending[k].first, copies[k], pending[k].second);
+			}
+			std::string text = std::to_string(iteration) + "\n";
+			write_file(dir + "/latest.tmp", text.c_str(), text.size());
+			int ret = rename((dir + "/latest.tmp").c_str(), (dir + "/latest").c_str());
+			assert(ret==0);
+			if (previous!=0 && previous!=iteration) {
+				remove_directory(dir + "/" + std::to_string(previous));
+			}
+		});
+		return true;
+	}
+
+	// block until the checkpoint being written is complete
+	void wait() {
+		if (writer.joinable()) writer.join();
+		for (char * copy : copies) {
+			free(copy);
+		}
+		copies.clear();
+	}
+
+	// drop every checkpoint, once the algorithm has finished
+	void clear() {
+		wait();
+		if (file_exists(dir)) {
+			remove_directory(dir);
+		}
+	}
+};
+
+#endif
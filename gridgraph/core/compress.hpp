@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "core/type.hpp"
+
+// edge types in meta: 0 = unweighted, 1 = weighted, 2 = compressed unweighted, 3 = compressed weighted
+inline bool is_weighted(int edge_type) {
+	return edge_type & 1;
+}
+
+inline bool is_compressed(int edge_type) {
+	return edge_type >= 2;
+}
+
+// a compressed block is a sequence of self-contained frames of FRAME_SIZE bytes:
+//   header | sources - source_base, packed | targets - target_base, packed | weights (if weighted)
+// each packed run holds count values of a fixed bit width and is padded to 8 bytes. the last 8 bytes of a
+// frame stay unused so that unaligned 8-byte loads of the last value never leave the frame.
+#define FRAME_SIZE 4096
+#define FRAME_EDGES 2048
+#define MAX_PACKED_BITS 57 // a value plus its bit offset must fit one 8-byte load
+
+struct FrameHeader {
+	unsigned int count; // 0 for padding
+	VertexId source_base;
+	VertexId target_base;
+	unsigned char source_bits;
+	unsigned char target_bits;
+	unsigned short reserved;
+};
+
+inline long packed_bytes(long count, int bits) {
+	return (count * bits + 63) / 64 * 8;
+}
+
+inline int bit_width(unsigned long range) {
+	return range==0 ? 0 : 64 - __builtin_clzl(range);
+}
+
+inline long frame_bytes(long count, int source_bits, int target_bits, bool weighted) {
+	return sizeof(FrameHeader) + packed_bytes(count, source_bits) + packed_bytes(count, target_bits) + (weighted ? sizeof(Weight) * count : 0) + 8;
+}
+
+inline void pack(char * data, int bits, VertexId base, const Edge * edges, int count, bool source) {
+	for (int k=0;k<count;k++) {
+		unsigned long value = (unsigned long)((source ? edges[k].source : edges[k].target) - base);
+		long position = (long)k * bits;
+		unsigned long word;
+		memcpy(&word, data + (position >> 3), sizeof(word));
+		word |= value << (position & 7);
+		memcpy(data + (position >> 3), &word, sizeof(word));
+	}
+}
+
+// fill one frame with as many of the given edges as fit (edges sorted by source pack best); returns how many
+inline int encode_frame(const Edge * edges, long count, bool weighted, char * frame) {
+	VertexId source_min = edges[0].source, source_max = edges[0].source;
+	VertexId target_min = edges[0].target, target_max = edges[0].target;
+	int n = 1;
+	while (n < count && n < FRAME_EDGES) {
+		VertexId next_source_min = std::min(source_min, edges[n].source), next_source_max = std::max(source_max, edges[n].source);
+		VertexId next_target_min = std::min(target_min, edges[n].target), next_target_max = std::max(target_max, edges[n].target);
+		int source_bits = bit_width(next_source_max - next_source_min), target_bits = bit_width(next_target_max - next_target_min);
+		if (source_bits > MAX_PACKED_BITS || target_bits > MAX_PACKED_BITS) break;
+		if (frame_bytes(n + 1, source_bits, target_bits, weighted) > FRAME_SIZE) break;
+		source_min = next_source_min;
+		source_max = next_source_max;
+		target_min = next_target_min;
+		target_max = next_target_max;
+		n++;
+	}
+	memset(frame, 0, FRAME_SIZE);
+	FrameHeader * header = (FrameHeader *)frame;
+	header->count = n;
+	header->source_base = source_min;
+	header->target_base = target_min;
+	header->source_bits = bit_width(source_max - source_min);
+	header->target_bits = bit_width(target_max - target_min);
+	char * data = frame + sizeof(FrameHeader);
+	pack(data, header->source_bits, source_min, edges, n, true);
+	data += packed_bytes(n, header->source_bits);
+	pack(data, header->target_bits, target_min, edges, n, false);
+	data += packed_bytes(n, header->target_bits);
+	if (weighted) {
+		for (int k=0;k<n;k++) {
+			((Weight *)data)[k] = edges[k].weight;
+		}
+	}
+	return n;
+}
+
+inline void unpack_scalar(const char * data, int bits, int count, VertexId base, VertexId * out) {
+	unsigned long mask = (1ul << bits) - 1;
+	for (int k=0;k<count;k++) {
+		long position = (long)k * bits;
+		unsigned long word;
+		memcpy(&word, data + (position >> 3), sizeof(word));
+		out[k] = base + (VertexId)((word >> (position & 7)) & mask);
+	}
+}
+
+#if defined(__x86_64__)
+// four values per step: gather the 8-byte words holding them, shift each lane by its bit offset, mask
+__attribute__((target("avx2")))
+inline void unpack_avx2(const char * data, int bits, int count, VertexId base, VertexId * out) {
+	const __m256i mask = _mm256_set1_epi64x((1ll << bits) - 1);
+	const __m256i seven = _mm256_set1_epi64x(7);
+	const __m256i step = _mm256_set1_epi64x(4l * bits);
+	const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	const __m128i bases = _mm_set1_epi32(base);
+	__m256i position = _mm256_mul_epu32(_mm256_setr_epi64x(0, 1, 2, 3), _mm256_set1_epi64x(bits));
+	int k = 0;
+	for (;k+4<=count;k+=4) {
+		__m256i words = _mm256_i64gather_epi64((const long long *)data, _mm256_srli_epi64(position, 3), 1);
+		words = _mm256_and_si256(_mm256_srlv_epi64(words, _mm256_and_si256(position, seven)), mask);
+		__m128i values = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(words, low_halves));
+		_mm_storeu_si128((__m128i *)(out + k), _mm_add_epi32(values, bases));
+		position = _mm256_add_epi64(position, step);
+	}
+	for (;k<count;k++) {
+		long p = (long)k * bits;
+		unsigned long word;
+		memcpy(&word, data + (p >> 3), sizeof(word));
+		out[k] = base + (VertexId)((word >> (p & 7)) & ((1ul << bits) - 1));
+	}
+}
+#endif
+
+inline void unpack(const char * data, int bits, int count, VertexId base, VertexId * out) {
+#if defined(__x86_64__)
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2 && sizeof(VertexId)==4) {
+		unpack_avx2(data, bits, count, base, out);
+		return;
+	}
+#endif
+	unpack_scalar(data, bits, count, base, out);
+}
+
+// decode one frame into sources and targets (FRAME_EDGES each); weights point into the frame
+inline int decode_frame(const char * frame, bool weighted, VertexId * sources, VertexId * targets, const Weight * & weights) {
+	const FrameHeader * header = (const FrameHeader *)frame;
+	int count = header->count;
+	const char * data = frame + sizeof(FrameHeader);
+	unpack(data, header->source_bits, count, header->source_base, sources);
+	data += packed_bytes(count, header->source_bits);
+	unpack(data, header->target_bits, count, header->target_base, targets);
+	data += packed_bytes(count, header->target_bits);
+	weights = weighted ? (const Weight *)data : NULL;
+	return count;
+}
+
+#endif
@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "core/type.hpp"
+#include "core/filesystem.hpp"
+#include "core/partition.hpp"
+#include "core/compress.hpp"
+
+// edges inserted after preprocessing are appended to [path]/delta/i-j, one file per block (i,j), in the
+// layout of the grid: raw records, or whole frames for compressed grids. stream_edges reads them after
+// the base block until tools/compact folds them into the row and column files.
+
+inline std::string delta_file(std::string path, int i, int j) {
+	return path + "/delta/" + std::to_string(i) + "-" + std::to_string(j);
+}
+
+// inserts and compaction hold the lock exclusively, creating [path]/delta on first use
+inline int lock_delta(std::string path, int operation) {
+	create_directory(path + "/delta");
+	int fd = open((path + "/delta/lock").c_str(), O_RDONLY | O_CREAT, 0644);
+	assert(fd!=-1);
+	int ret = flock(fd, operation);
+	assert(ret==0);
+	return fd;
+}
+
+// opening a grid holds the lock shared without creating anything, so read-only grids can be opened. returns -1
+// if nothing was ever inserted: there are no deltas to read then, and an insert starting later only appends
+// after the opened state
+inline int lock_delta_shared(std::string path) {
+	int fd = open((path + "/delta/lock").c_str(), O_RDONLY);
+	if (fd==-1) {
+		assert(errno==ENOENT);
+		return -1;
+	}
+	int ret = flock(fd, LOCK_SH);
+	assert(ret==0);
+	return fd;
+}
+
+inline void unlock_delta(int fd) {
+	if (fd==-1) return;
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+// the bytes of every block's deltas, delta_bytes[i*partitions+j]; only the existing files are visited
+inline void delta_sizes(std::string path, int partitions, long * delta_bytes) {
+	for (int ij=0;ij<partitions*partitions;ij++) {
+		delta_bytes[ij] = 0;
+	}
+	DIR * dir = opendir((path + "/delta").c_str());
+	if (dir==NULL) return;
+	struct dirent * entry;
+	while ((entry = readdir(dir))!=NULL) {
+		int i, j;
+		char tail;
+		if (sscanf(entry->d_name, "%d-%d%c", &i, &j, &tail)!=2) continue;
+		if (i<0 || i>=partitions || j<0 || j>=partitions) continue;
+		delta_bytes[i*partitions+j] = file_size(delta_file(path, i, j));
+	}
+	closedir(dir);
+}
+
+// the edges held by the first bytes of a delta file
+inline long delta_edges(int fd, long bytes, int edge_type) {
+	if (!is_compressed(edge_type)) {
+		return bytes / (is_weighted(edge_type) ? sizeof(VertexId) * 2 + sizeof(Weight) : sizeof(VertexId) * 2);
+	}
+	long edges = 0;
+	for (long pos=0;pos<bytes;pos+=FRAME_SIZE) {
+		FrameHeader header;
+		long read_bytes = pread(fd, &header, sizeof(header), pos);
+		assert(read_bytes==sizeof(header));
+		edges += header.count;
+	}
+	return edges;
+}
+
+// the edges in the layout of the grid: raw records, or frames of the edges sorted by source
+inline void encode_edges(std::vector<Edge> & edges, int edge_type, std::vector<char> & out) {
+	bool weighted = is_weighted(edge_type);
+	out.clear();
+	if (!is_compressed(edge_type)) {
+		int edge_unit = weighted ? sizeof(VertexId) * 2 + sizeof(Weight) : sizeof(VertexId) * 2;
+		out.resize(edges.size() * edge_unit);
+		for (size_t e=0;e<edges.size();e++) {
+			memcpy(&out[e*edge_unit], &edges[e], edge_unit);
+		}
+		return;
+	}
+	std::sort(edges.begin(), edges.end(), [](const Edge & a, const Edge & b){
+		return a.source < b.source || (a.source==b.source && a.target < b.target);
+	});
+	for (size_t e=0;e<edges.size();) {
+		out.resize(out.size() + FRAME_SIZE);
+		e += encode_frame(edges.data()+e, edges.size()-e, weighted, out.data()+out.size()-FRAME_SIZE);
+	}
+}
+
+// append a batch of raw records (the preprocess input layout of the grid's edge type) to the delta store.
+// the cost is linear in the batch: the records are bucketed by block and each touched block gets one append.
+// the cached out-degrees no longer hold and are removed.
+inline void insert_edges(std::string path, int edge_type, VertexId vertices, int partitions, const char * records, long bytes) {
+	bool weighted = is_weighted(edge_type);
+	int edge_unit = weighted ? sizeof(VertexId) * 2 + sizeof(Weight) : sizeof(VertexId) * 2;
+	assert(bytes % edge_unit==0);
+	std::vector<std::vector<Edge> > blocks(partitions * partitions);
+	for (long pos=0;pos<bytes;pos+=edge_unit) {
+		Edge e;
+		e.source = *(const VertexId*)(records+pos);
+		e.target = *(const VertexId*)(records+pos+sizeof(VertexId));
+		e.weight = weighted ? *(const Weight*)(records+pos+sizeof(VertexId)*2) : 0;
+		if (e.source<0 || e.source>=vertices || e.target<0 || e.target>=vertices) {
+			fprintf(stderr, "edge (%ld, %ld) is out of the %ld vertices of %s\n", (long)e.source, (long)e.target, (long)vertices, path.c_str());
+			exit(-1);
+		}
+		int i = get_partition_id(vertices, partitions, e.source);
+		int j = get_partition_id(vertices, partitions, e.target);
+		blocks[i*partitions+j].push_back(e);
+	}
+	std::vector<char> encoded;
+	int lock = lock_delta(path, LOCK_EX);
+	for (int i=0;i<partitions;i++) {
+		for (int j=0;j<partitions;j++) {
+			std::vector<Edge> & edges = blocks[i*partitions+j];
+			if (edges.empty()) continue;
+			encode_edges(edges, edge_type, encoded);
+			int fout = open(delta_file(path, i, j).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+			assert(fout!=-1);
+			long written = write(fout, encoded.data(), encoded.size());
+			assert(written==(long)encoded.size());
+			close(fout);
+		}
+	}
+	unlink((path + "/out_degree").c_str());
+	unlock_delta(lock);
+}
+
+#endif
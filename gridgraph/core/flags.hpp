@@ -0,0 +1,41 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FLAGS_H
+#define FLAGS_H
+
+#include <string.h>
+
+#include <string>
+
+// remove the arguments starting with prefix (such as "--stats="), returning the value of the last one ("" when
+// absent), so that examples keep their positional arguments
+inline std::string take_flag(int & argc, char ** argv, const char * prefix) {
+	std::string value = "";
+	size_t length = strlen(prefix);
+	int kept = 1;
+	for (int i=1;i<argc;i++) {
+		if (strncmp(argv[i], prefix, length)==0) {
+			value = argv[i] + length;
+		} else {
+			argv[kept++] = argv[i];
+		}
+	}
+	argc = kept;
+	return value;
+}
+
+#endif
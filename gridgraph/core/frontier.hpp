@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include "core/type.hpp"
+#include "core/bitmap.hpp"
+
+// the active vertices of an iteration. the bitmap always holds the members, so add() deduplicates and
+// stream_edges can skip inactive blocks; while few vertices are active they are also kept in a queue,
+// which stream_vertices walks instead of the bitmap and clear() uses to reset only the words it touched.
+// once the queue overflows the frontier is dense until the next clear().
+class Frontier {
+	size_t capacity;
+	VertexId * queue;
+	volatile size_t count;
+	volatile bool sparse;
+public:
+	Bitmap bitmap;
+
+	// by default the queue holds one vertex per bitmap word: beyond that, scanning the words is cheaper
+	Frontier(size_t vertices, size_t capacity = 0) {
+		bitmap.init(vertices);
+		this->capacity = (capacity!=0) ? capacity : WORD_OFFSET(vertices) + 1;
+		queue = new VertexId [this->capacity];
+		count = 0;
+		sparse = true;
+	}
+	~Frontier() {
+		delete [] queue;
+	}
+	bool is_sparse() {
+		return sparse;
+	}
+	// the queued vertices (valid while sparse)
+	const VertexId * list() {
+		return queue;
+	}
+	size_t size() {
+		return sparse ? count : bitmap.count();
+	}
+	unsigned long contains(VertexId v) {
+		return bitmap.get_bit(v);
+	}
+	// returns whether v was not a member yet
+	bool add(VertexId v) {
+		if (bitmap.test_and_set_bit(v)) return false;
+		if (sparse) {
+			size_t k = __sync_fetch_and_add(&count, 1);
+			if (k < capacity) {
+				queue[k] = v;
+			} else {
+				sparse = false;
+			}
+		}
+		return true;
+	}
+	void clear() {
+		if (sparse) {
+			// every set bit belongs to a queued vertex, so their words and groups hold nothing else
+			for (size_t k=0;k<count;k++) {
+				VertexId v = queue[k];
+				bitmap.data[WORD_OFFSET(v)] = 0;
+				bitmap.summary[WORD_OFFSET(GROUP_OFFSET(v))] = 0;
+			}
+		} else {
+			bitmap.clear();
+		}
+		count = 0;
+		sparse = true;
+	}
+	void fill() {
+		bitmap.fill();
+		sparse = false;
+	}
+	// the bitmap was written directly (e.g. restored from a checkpoint): the queue no longer lists the members
+	void set_dense() {
+		sparse = false;
+	}
+};
+
+#endif
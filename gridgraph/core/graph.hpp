@@ -25,6 +25,8 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include <omp.h>
 #include <string.h>
 #include <functional>
+#include <algorithm>
+#include <utility>
 
 #include <thread>
 #include <vector>
@@ -32,11 +34,20 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include "core/constants.hpp"
 #include "core/type.hpp"
 #include "core/bitmap.hpp"
+#include "core/frontier.hpp"
 #include "core/atomic.hpp"
 #include "core/queue.hpp"
 #include "core/partition.hpp"
 #include "core/bigvector.hpp"
 #include "core/time.hpp"
+#include "core/threadpool.hpp"
+#include "core/io.hpp"
+#include "core/accumulator.hpp"
+#include "core/compress.hpp"
+#include "core/delta.hpp"
+#include "core/cache.hpp"
+#include "core/stats.hpp"
+#include "core/flags.hpp"
 
 bool f_true(VertexId v) {
 	return true;
@@ -50,18 +61,407 @@ void f_none_2(std::pair<VertexId,VertexId> source_vid_range, std::pair<VertexId,
 
 }
 
+#define PUSH 0
+#define PULL 1
+
+// vertices of a sparse frontier handed to a thread at a time; smaller frontiers run on the calling thread
+#define FRONTIER_STEP 1024
+
 class Graph {
 	int parallelism;
 	int edge_unit;
 	bool * should_access_shard;
+	bool * should_access_block;
+	long * block_group_offset; // where the source group mask of block (i,j) starts in block_groups
+	unsigned long * block_groups; // bit g of block (i,j): some edge of the block has a source in group first_group(i)+g
+	long total_read_bytes;
+	long total_skipped_bytes;
+	BigVector<VertexId> * out_degree;
+	int direction;
+	double alpha;
+	double beta;
 	long ** fsize;
 	char ** buffer_pool;
 	long * column_offset;
 	long * row_offset;
+	long * delta_bytes; // bytes of the inserted edges of block (i,j), as of opening the grid
+	int * delta_fd;
+	int row_fd; // the grid files as of opening; a later compaction renames new files over them
+	int column_fd;
 	long memory_bytes;
 	int partition_batch;
 	long vertex_data_bytes;
+	std::vector<BigVectorBase *> hinted; // the vectors of the last hint(), whose windows are pipelined
 	long PAGESIZE;
+	ThreadPool * pool;
+	TaskQueue<std::tuple<int, long, long> > * tasks;
+	int queue_type;
+	bool numa_affine;
+	int numa_domains; // nodes that own partitions and run workers; 1 unless NUMA affinity is on
+	std::vector<int> worker_domain; // the node of each worker
+	std::vector<int> domain_workers;
+	std::vector<TaskQueue<std::tuple<int, long, long> > *> domain_tasks; // per node, for target oriented chunks
+	int io_backend;
+	int io_depth;
+	AsyncReader ** readers;
+	EdgeCache * edge_cache;
+	int cached_fd; // the grid file of the current streaming call, whose chunks go through the cache
+	int cached_layout; // 0 for row, 1 for column
+	long call_hit_bytes;
+	long call_miss_bytes;
+	FILE * stats_out; // JSON lines of every stream_edges call, or NULL
+	long stats_calls;
+	std::vector<StreamStats> thread_stats;
+
+	void alloc_buffers() {
+		buffer_pool = new char * [parallelism*io_depth];
+		for (int i=0;i<parallelism*io_depth;i++) {
+			buffer_pool[i] = (char *)memalign(PAGESIZE, IOSIZE);
+			assert(buffer_pool[i]!=NULL);
+			memset(buffer_pool[i], 0, IOSIZE);
+		}
+		readers = new AsyncReader * [parallelism];
+		for (int i=0;i<parallelism;i++) {
+			readers[i] = new AsyncReader(io_depth, io_backend);
+		}
+	}
+
+	void free_buffers() {
+		for (int i=0;i<parallelism*io_depth;i++) {
+			free(buffer_pool[i]);
+		}
+		delete [] buffer_pool;
+		for (int i=0;i<parallelism;i++) {
+			delete readers[i];
+		}
+		delete [] readers;
+	}
+
+	// pin the workers and split them over the nodes when NUMA affinity is on: node d runs a contiguous share of
+	// the workers on its cpus, and owns the partitions that partition_node maps to it
+	void assign_workers() {
+		for (auto queue : domain_tasks) delete queue;
+		domain_tasks.clear();
+		numa_domains = 1;
+		worker_domain.assign(parallelism, 0);
+		domain_workers.assign(1, parallelism);
+		if (!numa_affine) return;
+		int nodes = numa_nodes();
+		std::vector<std::vector<int> > node_cpus(nodes);
+		bool usable = parallelism >= nodes;
+		for (int d=0;d<nodes;d++) {
+			node_cpus[d] = numa_node_cpus(d);
+			if (node_cpus[d].empty()) usable = false; // a memory-only (or disallowed) node can not run its partitions
+		}
+		if (!usable) {
+			pool->pin();
+			return;
+		}
+		numa_domains = nodes;
+		domain_workers.assign(nodes, 0);
+		std::vector<int> cpus(parallelism);
+		for (int t=0;t<parallelism;t++) {
+			int d = partition_node(t, parallelism, nodes);
+			worker_domain[t] = d;
+			cpus[t] = node_cpus[d][domain_workers[d] % node_cpus[d].size()];
+			domain_workers[d]++;
+		}
+		pool->pin(cpus);
+		if (numa_domains>1) {
+			for (int d=0;d<numa_domains;d++) {
+				domain_tasks.push_back(new TaskQueue<std::tuple<int, long, long> >(65536, queue_type));
+			}
+		}
+	}
+
+	// a queue of the partitions (or columns) in items, each given to the node owning it first
+	PartitionQueue partition_queue(const std::vector<int> & items) {
+		std::vector<int> item_domains(items.size());
+		for (size_t k=0;k<items.size();k++) {
+			item_domains[k] = partition_node(items[k], partitions, numa_domains);
+		}
+		return PartitionQueue(items, item_domains, numa_domains);
+	}
+
+	std::vector<int> partition_list(int begin_partition, int end_partition) {
+		std::vector<int> items;
+		for (int p=begin_partition;p<end_partition;p++) {
+			items.push_back(p);
+		}
+		return items;
+	}
+
+	size_t first_group(int partition_id) {
+		return GROUP_OFFSET(get_partition_range(vertices, partitions, partition_id).first);
+	}
+
+	size_t last_group(int partition_id) {
+		size_t end_vid = get_partition_range(vertices, partitions, partition_id).second;
+		return (end_vid==0) ? 0 : GROUP_OFFSET(end_vid - 1);
+	}
+
+	// source group masks of every block; computed by one pass over the grid and cached next to it
+	void load_block_groups() {
+		long words = block_group_offset[partitions*partitions];
+		std::string filename = path + "/block_groups";
+		block_groups = new unsigned long [words]();
+		if (file_exists(filename) && file_size(filename)==(long)sizeof(unsigned long) * words) {
+			int fin = open(filename.c_str(), O_RDONLY);
+			long bytes = read(fin, block_groups, sizeof(unsigned long) * words);
+			assert(bytes==(long)sizeof(unsigned long) * words);
+			close(fin);
+			return;
+		}
+		unsigned long * masks = block_groups;
+		block_groups = NULL;
+		stream_edges<VertexId>([&](UnweightedEdge & e){
+			int i = get_partition_id(vertices, partitions, e.source);
+			int j = get_partition_id(vertices, partitions, e.target);
+			size_t group = GROUP_OFFSET(e.source) - first_group(i);
+			unsigned long * word = masks + block_group_offset[i*partitions+j] + WORD_OFFSET(group);
+			if (!(*word & (1ul<<BIT_OFFSET(group)))) {
+				__sync_fetch_and_or(word, 1ul<<BIT_OFFSET(group));
+			}
+			return 0;
+		}, nullptr, 0, 0);
+		block_groups = masks;
+		int fout = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		long bytes = write(fout, block_groups, sizeof(unsigned long) * words);
+		assert(bytes==(long)sizeof(unsigned long) * words);
+		close(fout);
+	}
+
+	// whether block (i,j) has an edge whose source group is marked in the frontier summary; the masks
+	// may predate the inserted edges, so a block with deltas counts as active
+	bool block_is_active(Bitmap * bitmap, int i, int j) {
+		if (delta_bytes[i*partitions+j]!=0) return true;
+		size_t base = first_group(i);
+		unsigned long * mask = block_groups + block_group_offset[i*partitions+j];
+		long words = block_group_offset[i*partitions+j+1] - block_group_offset[i*partitions+j];
+		for (long w=0;w<words;w++) {
+			unsigned long word = mask[w];
+			while (word!=0) {
+				if (bitmap->get_group(base + (w << 6) + __builtin_ctzl(word))) return true;
+				word &= word - 1;
+			}
+		}
+		return false;
+	}
+
+	// split the bytes of one block into page aligned chunks of at most IOSIZE, continuing from offset
+	template <typename P>
+	void split_block(long begin_offset, long end_offset, long & offset, P push) {
+		if (begin_offset - offset >= PAGESIZE) {
+			offset = begin_offset / PAGESIZE * PAGESIZE;
+		}
+		if (end_offset <= offset) return;
+		const long chunk_size = IOSIZE / PAGESIZE * PAGESIZE; // chunks start on record boundaries
+		while (end_offset - offset >= chunk_size) {
+			push(offset, chunk_size);
+			offset += chunk_size;
+		}
+		if (end_offset > offset) {
+			long length = (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+			push(offset, length);
+			offset += length;
+		}
+	}
+
+	// split the inserted edges of block (i,j) into chunks of at most IOSIZE; they are read with buffered I/O,
+	// so the last chunk ends exactly where the deltas did when the grid was opened
+	template <typename P>
+	void split_delta(int i, int j, P push) {
+		long bytes = delta_bytes[i*partitions+j];
+		const long chunk_size = IOSIZE / PAGESIZE * PAGESIZE;
+		for (long offset=0;offset<bytes;offset+=chunk_size) {
+			push(delta_fd[i*partitions+j], offset, std::min(chunk_size, bytes - offset));
+		}
+	}
+
+	// the edges of the current window that the kernel should see
+	struct EdgeFilter {
+		Bitmap * bitmap;
+		Bitmap * target_bitmap;
+		VertexId begin_vid;
+		VertexId end_vid;
+		VertexId target_begin_vid;
+		VertexId target_end_vid;
+		bool pass(UnweightedEdge & e) {
+			if (e.source < begin_vid || e.source >= end_vid) {
+				return false;
+			}
+			if (e.target < target_begin_vid || e.target >= target_end_vid) {
+				return false;
+			}
+			if (target_bitmap!=nullptr && !target_bitmap->get_bit(e.target)) {
+				return false;
+			}
+			return bitmap==nullptr || bitmap->get_bit(e.source);
+		}
+	};
+
+	// hand the record to a kernel that takes it (or a base of it) directly ...
+	template <typename F, typename R>
+	static auto apply_kernel(F & process, R & record, int) -> decltype(process(record)) {
+		return process(record);
+	}
+
+	// ... or widen an unweighted record for a kernel that takes Edge &, with a zero weight
+	template <typename F, typename R>
+	static auto apply_kernel(F & process, R & record, long) -> decltype(process(std::declval<Edge &>())) {
+		Edge e;
+		e.source = record.source;
+		e.target = record.target;
+		e.weight = 0;
+		return process(e);
+	}
+
+	// process the chunks handed out by next_task on one worker, keeping up to io_depth reads in flight
+	template <typename T, typename F, typename N>
+	void stream_chunks(int thread_id, F & process, Bitmap * bitmap, Bitmap * target_bitmap, VertexId begin_vid, VertexId end_vid,
+		VertexId target_begin_vid, VertexId target_end_vid, T & local_value, long & local_read_bytes, N next_task) {
+		AsyncReader * reader = readers[thread_id];
+		unsigned depth = reader->uses_uring() ? io_depth : 1;
+		std::vector<long> chunk_offset(depth);
+		std::vector<long> chunk_length(depth);
+		std::vector<bool> chunk_cached(depth);
+		std::vector<unsigned long> free_slots;
+		for (unsigned slot=0;slot<depth;slot++) {
+			free_slots.push_back(slot);
+		}
+		bool compressed = is_compressed(edge_type);
+		EdgeFilter filter = {bitmap, target_bitmap, begin_vid, end_vid, target_begin_vid, target_end_vid};
+		std::vector<VertexId> sources(compressed ? FRAME_EDGES : 0);
+		std::vector<VertexId> targets(compressed ? FRAME_EDGES : 0);
+		StreamStats * stats = (stats_out!=NULL) ? &thread_stats[thread_id] : NULL;
+		double start_time = 0;
+		// the record layout, and so the stride, is a compile-time constant inside each loop
+		auto consume = [&](char * buffer, long offset, long bytes){
+			switch (edge_type) {
+			case 0:
+				for (long pos=offset % sizeof(UnweightedEdge);pos+sizeof(UnweightedEdge)<=bytes;pos+=sizeof(UnweightedEdge)) {
+					UnweightedEdge & e = *(UnweightedEdge*)(buffer+pos);
+					if (filter.pass(e)) local_value += apply_kernel(process, e, 0);
+				}
+				break;
+			case 1:
+				for (long pos=offset % sizeof(Edge);pos+sizeof(Edge)<=bytes;pos+=sizeof(Edge)) {
+					Edge & e = *(Edge*)(buffer+pos);
+					if (filter.pass(e)) local_value += apply_kernel(process, e, 0);
+				}
+				break;
+			case 2:
+				for (long pos=0;pos+FRAME_SIZE<=bytes;pos+=FRAME_SIZE) {
+					const Weight * weights;
+					int count = decode_frame(buffer+pos, false, sources.data(), targets.data(), weights);
+					for (int k=0;k<count;k++) {
+						UnweightedEdge e;
+						e.source = sources[k];
+						e.target = targets[k];
+						if (filter.pass(e)) local_value += apply_kernel(process, e, 0);
+					}
+				}
+				break;
+			case 3:
+				for (long pos=0;pos+FRAME_SIZE<=bytes;pos+=FRAME_SIZE) {
+					const Weight * weights;
+					int count = decode_frame(buffer+pos, true, sources.data(), targets.data(), weights);
+					for (int k=0;k<count;k++) {
+						Edge e;
+						e.source = sources[k];
+						e.target = targets[k];
+						e.weight = weights[k];
+						if (filter.pass(e)) local_value += apply_kernel(process, e, 0);
+					}
+				}
+				break;
+			default:
+				assert(false);
+			}
+		};
+		bool drained = false;
+		while (true) {
+			while (!drained && reader->outstanding() < depth) {
+				std::tuple<int, long, long> task;
+				bool wait = reader->outstanding()==0;
+				if (stats!=NULL && wait) start_time = get_time();
+				if (!next_task(wait, task)) break;
+				if (stats!=NULL && wait) stats->queue_wait += get_time() - start_time;
+				int fin;
+				long offset, length;
+				std::tie(fin, offset, length) = task;
+				if (fin==-1) {
+					drained = true;
+					break;
+				}
+				bool cached = edge_cache!=NULL && fin==cached_fd;
+				if (cached) {
+					long bytes;
+					char * data = edge_cache->acquire(cached_layout, offset, length, bytes);
+					if (data!=NULL) {
+						if (stats!=NULL) start_time = get_time();
+						consume(data, offset, bytes);
+						if (stats!=NULL) {
+							stats->kernel += get_time() - start_time;
+							stats->chunks++;
+							stats->cached_chunks++;
+						}
+						edge_cache->release(cached_layout, offset, length);
+						__sync_fetch_and_add(&call_hit_bytes, bytes);
+						continue;
+					}
+				}
+				unsigned long slot = free_slots.back();
+				free_slots.pop_back();
+				chunk_offset[slot] = offset;
+				chunk_length[slot] = length;
+				chunk_cached[slot] = cached;
+				reader->submit(fin, buffer_pool[thread_id*io_depth+slot], length, offset, slot);
+			}
+			if (reader->outstanding()==0) break;
+			unsigned long slot;
+			if (stats!=NULL) start_time = get_time();
+			long bytes = reader->wait(slot);
+			assert(bytes>0);
+			local_read_bytes += bytes;
+			char * buffer = buffer_pool[thread_id*io_depth+slot];
+			if (stats!=NULL) {
+				double end_time = get_time();
+				stats->read_wait += end_time - start_time;
+				start_time = end_time;
+			}
+			consume(buffer, chunk_offset[slot], bytes);
+			if (stats!=NULL) {
+				stats->kernel += get_time() - start_time;
+				stats->chunks++;
+				stats->bytes += bytes;
+			}
+			if (chunk_cached[slot]) {
+				edge_cache->admit(cached_layout, chunk_offset[slot], chunk_length[slot], buffer, bytes);
+				__sync_fetch_and_add(&call_miss_bytes, bytes);
+			}
+			free_slots.push_back(slot);
+		}
+	}
+
+	// drain a task queue on one worker
+	template <typename T, typename F>
+	void stream_queued_chunks(int thread_id, F & process, Bitmap * bitmap, Bitmap * target_bitmap, VertexId begin_vid, VertexId end_vid, T zero, T & value, long & read_bytes,
+		TaskQueue<std::tuple<int, long, long> > * queue) {
+		T local_value = zero;
+		long local_read_bytes = 0;
+		stream_chunks(thread_id, process, bitmap, target_bitmap, begin_vid, end_vid, 0, vertices, local_value, local_read_bytes,
+			[&](bool wait, std::tuple<int, long, long> & task){
+				if (wait) {
+					task = queue->pop();
+					return true;
+				}
+				return queue->try_pop(task);
+			}
+		);
+		write_add(&value, local_value);
+		write_add(&read_bytes, local_read_bytes);
+	}
 public:
 	std::string path;
 
@@ -73,15 +473,155 @@ public:
 	Graph (std::string path) {
 		PAGESIZE = 4096;
 		parallelism = std::thread::hardware_concurrency();
-		buffer_pool = new char * [parallelism*1];
-		for (int i=0;i<parallelism*1;i++) {
-			buffer_pool[i] = (char *)memalign(PAGESIZE, IOSIZE);
-			assert(buffer_pool[i]!=NULL);
-			memset(buffer_pool[i], 0, IOSIZE);
-		}
+		io_backend = IO_URING;
+		io_depth = 2;
+		alloc_buffers();
+		pool = new ThreadPool(parallelism);
+		queue_type = QUEUE_LOCKFREE;
+		tasks = new TaskQueue<std::tuple<int, long, long> >(65536, queue_type);
+		numa_affine = false;
+		assign_workers();
+		edge_cache = NULL;
+		cached_fd = -1;
+		call_hit_bytes = 0;
+		call_miss_bytes = 0;
+		stats_out = NULL;
+		stats_calls = 0;
+		thread_stats.resize(parallelism);
 		init(path);
 	}
 
+	~Graph() {
+		set_stats("");
+		delete edge_cache;
+		for (int ij=0;ij<partitions*partitions;ij++) {
+			if (delta_fd[ij]!=-1) close(delta_fd[ij]);
+		}
+		close(row_fd);
+		close(column_fd);
+		delete out_degree;
+		for (auto queue : domain_tasks) delete queue;
+		delete tasks;
+		delete pool;
+		free_buffers();
+	}
+
+	// IO_URING (default, falls back to pread when unavailable) or IO_PREAD; depth reads in flight per worker
+	void set_io(int io_backend, int io_depth) {
+		assert(io_depth>=1);
+		free_buffers();
+		this->io_backend = io_backend;
+		this->io_depth = io_depth;
+		alloc_buffers();
+	}
+
+	// the number of streaming workers, hardware_concurrency() by default
+	void set_parallelism(int threads) {
+		assert(threads>=1);
+		free_buffers();
+		delete pool;
+		parallelism = threads;
+		alloc_buffers();
+		pool = new ThreadPool(parallelism);
+		thread_stats.resize(parallelism);
+		assign_workers();
+	}
+
+	// QUEUE_LOCKFREE (default) or QUEUE_MUTEX for dispatching edge chunks to workers
+	void set_queue_type(int queue_type) {
+		this->queue_type = queue_type;
+		delete tasks;
+		tasks = new TaskQueue<std::tuple<int, long, long> >(65536, queue_type);
+		assign_workers();
+	}
+
+	// NUMA affinity: workers are pinned to the cpus of the node they are assigned to, and every node first
+	// processes the partitions it owns (see partition_node, which BigVector::place also follows) in stream_vertices,
+	// and the columns it owns in the target oriented stream_edges modes. turning it off unpins the workers
+	void set_numa_affinity(bool affine) {
+		if (numa_affine && !affine) {
+			delete pool;
+			pool = new ThreadPool(parallelism);
+		}
+		numa_affine = affine;
+		assign_workers();
+	}
+
+	// the nodes that own partitions, 1 unless NUMA affinity is on (and every node has cpus and a worker)
+	int get_numa_domains() {
+		return numa_domains;
+	}
+
+	// bind each streaming worker to a fixed core
+	void pin_threads() {
+		pool->pin();
+	}
+
+	// average time (in seconds) for the workers to pick up a streaming call
+	double stream_startup_time() {
+		if (pool->jobs==0) return 0;
+		return pool->startup_time / pool->jobs;
+	}
+
+	long stream_calls() {
+		return pool->jobs;
+	}
+
+	int get_parallelism() {
+		return parallelism;
+	}
+
+	// edge bytes read by stream_edges so far, and bytes of blocks skipped because no source was active
+	long streamed_bytes() {
+		return total_read_bytes;
+	}
+
+	long skipped_bytes() {
+		return total_skipped_bytes;
+	}
+
+	// append a JSON line per stream_edges call to filename, with the time every worker spent waiting for reads,
+	// in the kernel and on the task queue ("" stops). "-" writes to stdout
+	void set_stats(std::string filename) {
+		if (stats_out!=NULL && stats_out!=stdout) fclose(stats_out);
+		stats_out = NULL;
+		if (filename=="") return;
+		stats_out = (filename=="-") ? stdout : fopen(filename.c_str(), "a");
+		assert(stats_out!=NULL);
+	}
+
+	// bytes of the grid in one orientation, inserted edges included
+	long edge_bytes() {
+		long bytes = 0;
+		for (int i=0;i<partitions;i++) {
+			for (int j=0;j<partitions;j++) {
+				bytes += fsize[i][j];
+			}
+		}
+		return bytes;
+	}
+
+	// keep up to bytes of edge chunks in memory across stream_edges calls (0 disables the cache). the cache
+	// takes its share of memory_bytes, so only the remaining budget decides between buffered and direct I/O
+	void set_edge_cache(long bytes) {
+		delete edge_cache;
+		edge_cache = (bytes > 0) ? new EdgeCache(bytes) : NULL;
+	}
+
+	// bytes of grid chunks the last stream_edges call found in the edge cache, and read because they were not
+	long cache_hit_bytes() {
+		return call_hit_bytes;
+	}
+
+	long cache_miss_bytes() {
+		return call_miss_bytes;
+	}
+
+	// bytes of the edge cache that RLIMIT_MEMLOCK left unpinned, and so may be swapped out
+	long cache_unpinned_bytes() {
+		return (edge_cache!=NULL) ? edge_cache->unpinned_bytes() : 0;
+	}
+
 	void set_memory_bytes(long memory_bytes) {
 		this->memory_bytes = memory_bytes;
 	}
@@ -93,37 +633,57 @@ public:
 	void init(std::string path) {
 		this->path = path;
 
+		// meta, the offsets, the grid files and the deltas are opened under the delta lock, so a compaction is
+		// seen entirely or not at all. the open descriptors keep reading the snapshot after a later compaction
+		int lock = lock_delta_shared(path);
+
+		// meta: edge type, vertices, edges, partitions and the id width in bytes (4 when absent)
 		FILE * fin_meta = fopen((path+"/meta").c_str(), "r");
-		fscanf(fin_meta, "%d %d %ld %d", &edge_type, &vertices, &edges, &partitions);
+		assert(fin_meta!=NULL);
+		long meta_vertices;
+		int id_bytes = 4;
+		int fields = fscanf(fin_meta, "%d %ld %ld %d %d", &edge_type, &meta_vertices, &edges, &partitions, &id_bytes);
+		assert(fields>=4);
 		fclose(fin_meta);
-
-		if (edge_type==0) {
-			PAGESIZE = 4096;
-		} else {
-			PAGESIZE = 12288;
+		if (id_bytes!=(int)sizeof(VertexId)) {
+			fprintf(stderr, "%s has %d-byte vertex ids, but this build uses %d-byte ids (see GRIDGRAPH_VERTEX64)\n", path.c_str(), id_bytes, (int)sizeof(VertexId));
+			exit(-1);
 		}
+		vertices = meta_vertices;
 
-		should_access_shard = new bool[partitions];
-
-		if (edge_type==0) {
+		if (!is_weighted(edge_type)) {
 			edge_unit = sizeof(VertexId) * 2;
 		} else {
 			edge_unit = sizeof(VertexId) * 2 + sizeof(Weight);
 		}
+		if (is_compressed(edge_type)) {
+			PAGESIZE = FRAME_SIZE; // blocks are whole frames, so chunks never cut one
+		} else {
+			// the smallest multiple of 4096 that holds whole records
+			PAGESIZE = 4096;
+			while (PAGESIZE % edge_unit!=0) PAGESIZE += 4096;
+		}
 
-		memory_bytes = 1024l*1024l*1024l*1024l; // assume RAM capacity is very large
-		partition_batch = partitions;
-		vertex_data_bytes = 0;
-
-		char filename[1024];
-		fsize = new long * [partitions];
+		should_access_shard = new bool[partitions];
+		should_access_block = new bool[partitions*partitions];
+		block_group_offset = new long [partitions*partitions+1];
+		block_group_offset[0] = 0;
 		for (int i=0;i<partitions;i++) {
-			fsize[i] = new long [partitions];
 			for (int j=0;j<partitions;j++) {
-				sprintf(filename, "%s/block-%d-%d", path.c_str(), i, j);
-				fsize[i][j] = file_size(filename);
+				block_group_offset[i*partitions+j+1] = block_group_offset[i*partitions+j] + WORD_OFFSET(last_group(i) - first_group(i)) + 1;
 			}
 		}
+		block_groups = NULL;
+		total_read_bytes = 0;
+		total_skipped_bytes = 0;
+		out_degree = NULL;
+		direction = PUSH;
+		alpha = 14;
+		beta = 24;
+
+		memory_bytes = 1024l*1024l*1024l*1024l; // assume RAM capacity is very large
+		partition_batch = partitions;
+		vertex_data_bytes = 0;
 
 		long bytes;
 
@@ -138,84 +698,178 @@ public:
 		bytes = read(fin_row_offset, row_offset, sizeof(long)*(partitions*partitions+1));
 		assert(bytes==sizeof(long)*(partitions*partitions+1));
 		close(fin_row_offset);
+
+		delta_bytes = new long [partitions*partitions];
+		delta_fd = new int [partitions*partitions];
+		if (lock!=-1) {
+			delta_sizes(path, partitions, delta_bytes);
+		} else {
+			for (int ij=0;ij<partitions*partitions;ij++) {
+				delta_bytes[ij] = 0;
+			}
+		}
+		row_fd = open((path+"/row").c_str(), O_RDONLY);
+		column_fd = open((path+"/column").c_str(), O_RDONLY);
+		assert(row_fd!=-1 && column_fd!=-1);
+		for (int ij=0;ij<partitions*partitions;ij++) {
+			delta_fd[ij] = -1;
+			if (delta_bytes[ij]==0) continue;
+			delta_fd[ij] = open(delta_file(path, ij / partitions, ij % partitions).c_str(), O_RDONLY);
+			assert(delta_fd[ij]!=-1);
+			edges += delta_edges(delta_fd[ij], delta_bytes[ij], edge_type);
+		}
+		unlock_delta(lock);
+
+		fsize = new long * [partitions];
+		for (int i=0;i<partitions;i++) {
+			fsize[i] = new long [partitions];
+			for (int j=0;j<partitions;j++) {
+				fsize[i][j] = row_offset[i*partitions+j+1] - row_offset[i*partitions+j] + delta_bytes[i*partitions+j];
+			}
+		}
 	}
 
 	Bitmap * alloc_bitmap() {
 		return new Bitmap(vertices);
 	}
 
+	Frontier * alloc_frontier() {
+		return new Frontier(vertices);
+	}
+
 	template <typename T>
 	T stream_vertices(std::function<T(VertexId)> process, Bitmap * bitmap = nullptr, T zero = 0,
+		std::function<void(std::pair<VertexId,VertexId>)> pre = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId>)> post = f_none_1) {
+		return stream_vertices<T, std::function<T(VertexId)> >(process, bitmap, zero, pre, post);
+	}
+
+	// same as above, but the kernel type is a template parameter so lambdas are inlined into the loop
+	template <typename T, typename F>
+	T stream_vertices(F process, Bitmap * bitmap = nullptr, T zero = 0,
 		std::function<void(std::pair<VertexId,VertexId>)> pre = f_none_1,
 		std::function<void(std::pair<VertexId,VertexId>)> post = f_none_1) {
 		T value = zero;
 		if (bitmap==nullptr && vertex_data_bytes > (0.8 * memory_bytes)) {
-			for (int cur_partition=0;cur_partition<partitions;cur_partition+=partition_batch) {
+			// a pipelined window holds up to three windows of each vector in memory (next, current, previous)
+			bool pipelined = begin_pipeline();
+			int batch = pipelined ? std::max(1, partition_batch / 3) : partition_batch;
+			for (int cur_partition=0;cur_partition<partitions;cur_partition+=batch) {
 				VertexId begin_vid, end_vid;
-				begin_vid = get_partition_range(vertices, partitions, cur_partition).first;
-				if (cur_partition+partition_batch>=partitions) {
-					end_vid = vertices;
-				} else {
-					end_vid = get_partition_range(vertices, partitions, cur_partition+partition_batch).first;
-				}
+				std::tie(begin_vid, end_vid) = window_range(cur_partition, batch);
 				pre(std::make_pair(begin_vid, end_vid));
-				#pragma omp parallel for schedule(dynamic) num_threads(parallelism)
-				for (int partition_id=cur_partition;partition_id<cur_partition+partition_batch;partition_id++) {
-					if (partition_id < partitions) {
-						T local_value = zero;
+				if (pipelined && cur_partition+batch<partitions) {
+					prefetch_window(window_range(cur_partition+batch, batch));
+				}
+				PartitionQueue queue = partition_queue(partition_list(cur_partition, std::min(cur_partition+batch, partitions)));
+				pool->run([&](int thread_id){
+					T local_value = zero;
+					int partition_id;
+					while ((partition_id = queue.pop(worker_domain[thread_id]))!=-1) {
 						VertexId begin_vid, end_vid;
 						std::tie(begin_vid, end_vid) = get_partition_range(vertices, partitions, partition_id);
 						for (VertexId i=begin_vid;i<end_vid;i++) {
 							local_value += process(i);
 						}
-						write_add(&value, local_value);
 					}
-				}
-				#pragma omp barrier
+					write_add(&value, local_value);
+				});
 				post(std::make_pair(begin_vid, end_vid));
 			}
+			if (pipelined) end_pipeline();
 		} else {
-			#pragma omp parallel for schedule(dynamic) num_threads(parallelism)
-			for (int partition_id=0;partition_id<partitions;partition_id++) {
+			PartitionQueue queue = partition_queue(partition_list(0, partitions));
+			pool->run([&](int thread_id){
 				T local_value = zero;
-				VertexId begin_vid, end_vid;
-				std::tie(begin_vid, end_vid) = get_partition_range(vertices, partitions, partition_id);
-				if (bitmap==nullptr) {
-					for (VertexId i=begin_vid;i<end_vid;i++) {
-						local_value += process(i);
-					}
-				} else {
-					VertexId i = begin_vid;
-					while (i<end_vid) {
-						unsigned long word = bitmap->data[WORD_OFFSET(i)];
-						if (word==0) {
-							i = (WORD_OFFSET(i) + 1) << 6;
-							continue;
+				int partition_id;
+				while ((partition_id = queue.pop(worker_domain[thread_id]))!=-1) {
+					VertexId begin_vid, end_vid;
+					std::tie(begin_vid, end_vid) = get_partition_range(vertices, partitions, partition_id);
+					if (bitmap==nullptr) {
+						for (VertexId i=begin_vid;i<end_vid;i++) {
+							local_value += process(i);
 						}
-						size_t j = BIT_OFFSET(i);
-						word = word >> j;
-						while (word!=0) {
-							if (word & 1) {
-								local_value += process(i);
+					} else {
+						VertexId i = begin_vid;
+						while (i<end_vid) {
+							if (!bitmap->get_group(GROUP_OFFSET(i))) {
+								i = (GROUP_OFFSET(i) + 1) << GROUP_SHIFT;
+								continue;
+							}
+							unsigned long word = bitmap->data[WORD_OFFSET(i)] >> BIT_OFFSET(i);
+							if (end_vid - i < 64) {
+								word &= (1ul << (end_vid - i)) - 1;
+							}
+							while (word!=0) {
+								local_value += process(i + __builtin_ctzl(word));
+								word &= word - 1;
 							}
-							i++;
-							j++;
-							word = word >> 1;
-							if (i==end_vid) break;
+							i = (WORD_OFFSET(i) + 1) << 6;
 						}
-						i += (64 - j);
 					}
 				}
 				write_add(&value, local_value);
+			});
+		}
+		return value;
+	}
+
+	// the members of a frontier; a sparse one is walked through its queue
+	template <typename T, typename F>
+	T stream_vertices(F process, Frontier & frontier, T zero = 0) {
+		if (!frontier.is_sparse()) {
+			return stream_vertices<T, F>(process, &frontier.bitmap, zero);
+		}
+		const VertexId * queue = frontier.list();
+		size_t count = frontier.size();
+		T value = zero;
+		if (count < FRONTIER_STEP) {
+			for (size_t k=0;k<count;k++) {
+				value += process(queue[k]);
 			}
-			#pragma omp barrier
+			return value;
 		}
+		size_t next = 0;
+		pool->run([&](int thread_id){
+			T local_value = zero;
+			size_t begin_k;
+			while ((begin_k = __sync_fetch_and_add(&next, FRONTIER_STEP)) < count) {
+				size_t end_k = std::min(begin_k + FRONTIER_STEP, count);
+				for (size_t k=begin_k;k<end_k;k++) {
+					local_value += process(queue[k]);
+				}
+			}
+			write_add(&value, local_value);
+		});
 		return value;
 	}
 
+	// the vertices of partitions [cur_partition, cur_partition+batch)
+	std::pair<VertexId,VertexId> window_range(int cur_partition, int batch) {
+		VertexId begin_vid = get_partition_range(vertices, partitions, cur_partition).first;
+		VertexId end_vid = (cur_partition+batch>=partitions) ? vertices : get_partition_range(vertices, partitions, cur_partition+batch).first;
+		return std::make_pair(begin_vid, end_vid);
+	}
+
+	// with several windows, the hinted vectors save in the background and the ones the pre hook loaded
+	// prefetch the next window while the current one is processed
+	bool begin_pipeline() {
+		if (hinted.empty() || partition_batch>=partitions) return false;
+		for (auto v : hinted) v->set_async_io(true);
+		return true;
+	}
+	void prefetch_window(std::pair<VertexId,VertexId> vid_range) {
+		for (auto v : hinted) {
+			if (v->window_loaded()) v->prefetch(vid_range.first, vid_range.second);
+		}
+	}
+	void end_pipeline() {
+		for (auto v : hinted) v->set_async_io(false);
+	}
+
 	void set_partition_batch(long bytes) {
 		int x = (int)ceil(bytes / (0.8 * memory_bytes));
-		partition_batch = partitions / x;
+		partition_batch = std::max(1, partitions / x);
 	}
 
 	template <typename... Args>
@@ -225,22 +879,135 @@ public:
 	void hint(BigVector<A> & a) {
 		long bytes = sizeof(A) * a.length;
 		set_partition_batch(bytes);
+		hinted = {&a};
 	}
 
 	template <typename A, typename B>
 	void hint(BigVector<A> & a, BigVector<B> & b) {
 		long bytes = sizeof(A) * a.length + sizeof(B) * b.length;
 		set_partition_batch(bytes);
+		hinted = {&a, &b};
 	}
 
 	template <typename A, typename B, typename C>
 	void hint(BigVector<A> & a, BigVector<B> & b, BigVector<C> & c) {
 		long bytes = sizeof(A) * a.length + sizeof(B) * b.length + sizeof(C) * c.length;
 		set_partition_batch(bytes);
+		hinted = {&a, &b, &c};
 	}
 
 	template <typename T>
 	T stream_edges(std::function<T(Edge&)> process, Bitmap * bitmap = nullptr, T zero = 0, int update_mode = 1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_source_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> post_source_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_target_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> post_target_window = f_none_1) {
+		return stream_edges<T, std::function<T(Edge&)> >(process, bitmap, zero, update_mode,
+			pre_source_window, post_source_window, pre_target_window, post_target_window);
+	}
+
+	// same as above, but the kernel type is a template parameter so lambdas are inlined into the loop
+	template <typename T, typename F>
+	T stream_edges(F process, Bitmap * bitmap = nullptr, T zero = 0, int update_mode = 1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_source_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> post_source_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_target_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> post_target_window = f_none_1) {
+		return stream_edges_filtered<T, F>(process, bitmap, nullptr, zero, update_mode,
+			pre_source_window, post_source_window, pre_target_window, post_target_window);
+	}
+
+	// the out-edges of a frontier's members
+	template <typename T, typename F>
+	T stream_edges(F process, Frontier & frontier, T zero = 0, int update_mode = 1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_source_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> post_source_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_target_window = f_none_1,
+		std::function<void(std::pair<VertexId,VertexId> vid_range)> post_target_window = f_none_1) {
+		return stream_edges_filtered<T, F>(process, &frontier.bitmap, nullptr, zero, update_mode,
+			pre_source_window, post_source_window, pre_target_window, post_target_window);
+	}
+
+	// traverse() switches to pull above edges / alpha frontier out-edges and back to push below vertices / beta frontier vertices
+	void set_direction_thresholds(double alpha, double beta) {
+		this->alpha = alpha;
+		this->beta = beta;
+	}
+
+	// PUSH or PULL, as chosen by the last traverse()
+	int last_direction() {
+		return direction;
+	}
+
+	// stream the out-edges of the active vertices in frontier, choosing a direction per call: while the
+	// frontier is sparse (its out-degree is at most edges / alpha) only the active rows of the row-oriented
+	// grid are read (push); once it is dense, the column-oriented grid is read instead (pull), skipping
+	// every column without a candidate target and filtering edges to non-candidates before the kernel.
+	// the pull direction is kept until fewer than vertices / beta vertices are active.
+	// candidates == nullptr means that every target may still be updated.
+	template <typename T, typename F>
+	T traverse(F process, Bitmap * frontier, Bitmap * candidates = nullptr, T zero = 0) {
+		if (out_degree==NULL) {
+			load_out_degree();
+		}
+		long frontier_vertices = stream_vertices<long>([&](VertexId i){
+			return 1;
+		}, frontier);
+		long frontier_edges = stream_vertices<long>([&](VertexId i){
+			return (long)(*out_degree)[i];
+		}, frontier);
+		choose_direction(frontier_vertices, frontier_edges);
+		if (direction==PUSH) {
+			return stream_edges_filtered<T, F>(process, frontier, candidates, zero, 0);
+		}
+		return stream_edges_filtered<T, F>(process, frontier, candidates, zero, 1);
+	}
+
+	// same as above for a frontier; a sparse one only costs its members to size up
+	template <typename T, typename F>
+	T traverse(F process, Frontier & frontier, Bitmap * candidates = nullptr, T zero = 0) {
+		if (out_degree==NULL) {
+			load_out_degree();
+		}
+		long frontier_vertices = frontier.size();
+		long frontier_edges = stream_vertices<long>([&](VertexId i){
+			return (long)(*out_degree)[i];
+		}, frontier, 0l);
+		choose_direction(frontier_vertices, frontier_edges);
+		if (direction==PUSH) {
+			return stream_edges_filtered<T, F>(process, &frontier.bitmap, candidates, zero, 0);
+		}
+		return stream_edges_filtered<T, F>(process, &frontier.bitmap, candidates, zero, 1);
+	}
+
+private:
+	void choose_direction(long frontier_vertices, long frontier_edges) {
+		if (partition_batch < partitions) {
+			// vertex data is windowed, which only the column-oriented grid supports
+			direction = PULL;
+		} else if (direction==PUSH && frontier_edges > edges / alpha) {
+			direction = PULL;
+		} else if (direction==PULL && frontier_vertices < vertices / beta) {
+			direction = PUSH;
+		}
+	}
+
+	void load_out_degree() {
+		std::string filename = path + "/out_degree";
+		bool cached = file_exists(filename) && file_size(filename)==(long)sizeof(VertexId) * vertices;
+		out_degree = new BigVector<VertexId>(filename, vertices);
+		if (cached) return;
+		out_degree->fill(0);
+		stream_edges<VertexId>([&](UnweightedEdge & e){
+			write_add(&(*out_degree)[e.source], 1);
+			return 0;
+		}, nullptr, 0, 0);
+		out_degree->sync();
+	}
+
+	// stream_edges, additionally skipping edges (and whole columns) whose target is not set in target_bitmap
+	template <typename T, typename F>
+	T stream_edges_filtered(F process, Bitmap * bitmap, Bitmap * target_bitmap, T zero, int update_mode,
 		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_source_window = f_none_1,
 		std::function<void(std::pair<VertexId,VertexId> vid_range)> post_source_window = f_none_1,
 		std::function<void(std::pair<VertexId,VertexId> vid_range)> pre_target_window = f_none_1,
@@ -249,187 +1016,267 @@ public:
 			for (int i=0;i<partitions;i++) {
 				should_access_shard[i] = true;
 			}
+			for (int ij=0;ij<partitions*partitions;ij++) {
+				should_access_block[ij] = true;
+			}
 		} else {
-			for (int i=0;i<partitions;i++) {
-				should_access_shard[i] = false;
+			if (block_groups==NULL) {
+				load_block_groups();
 			}
-			#pragma omp parallel for schedule(dynamic) num_threads(parallelism)
-			for (int partition_id=0;partition_id<partitions;partition_id++) {
-				VertexId begin_vid, end_vid;
-				std::tie(begin_vid, end_vid) = get_partition_range(vertices, partitions, partition_id);
-				VertexId i = begin_vid;
-				while (i<end_vid) {
-					unsigned long word = bitmap->data[WORD_OFFSET(i)];
-					if (word!=0) {
-						should_access_shard[partition_id] = true;
-						break;
+			int next_partition = 0;
+			pool->run([&](int thread_id){
+				int i;
+				while ((i = __sync_fetch_and_add(&next_partition, 1)) < partitions) {
+					VertexId begin_vid, end_vid;
+					std::tie(begin_vid, end_vid) = get_partition_range(vertices, partitions, i);
+					should_access_shard[i] = bitmap->any(begin_vid, end_vid);
+					for (int j=0;j<partitions;j++) {
+						should_access_block[i*partitions+j] = should_access_shard[i] && block_is_active(bitmap, i, j);
 					}
-					i = (WORD_OFFSET(i) + 1) << 6;
+				}
+			});
+		}
+		if (target_bitmap!=nullptr) {
+			for (int j=0;j<partitions;j++) {
+				VertexId begin_vid, end_vid;
+				std::tie(begin_vid, end_vid) = get_partition_range(vertices, partitions, j);
+				if (target_bitmap->any(begin_vid, end_vid)) continue;
+				for (int i=0;i<partitions;i++) {
+					should_access_block[i*partitions+j] = false;
 				}
 			}
-			#pragma omp barrier
 		}
 
 		T value = zero;
-		Queue<std::tuple<int, long, long> > tasks(65536);
-		std::vector<std::thread> threads;
 		long read_bytes = 0;
 
 		long total_bytes = 0;
+		long skipped_bytes = 0;
 		for (int i=0;i<partitions;i++) {
-			if (!should_access_shard[i]) continue;
 			for (int j=0;j<partitions;j++) {
-				total_bytes += fsize[i][j];
+				if (should_access_block[i*partitions+j]) {
+					total_bytes += fsize[i][j];
+				} else {
+					skipped_bytes += fsize[i][j];
+				}
 			}
 		}
+		long cache_bytes = 0;
+		if (edge_cache!=NULL) {
+			cache_bytes = edge_cache->size();
+			total_bytes = std::max(total_bytes - cache_bytes, 0l);
+		}
 		int read_mode;
-		if (memory_bytes < total_bytes) {
+		if (memory_bytes - cache_bytes < total_bytes) {
 			read_mode = O_RDONLY | O_DIRECT;
 			// printf("use direct I/O\n");
 		} else {
 			read_mode = O_RDONLY;
 			// printf("use buffered I/O\n");
 		}
+		// the grid files stay open for the lifetime of the graph; only their access mode changes per call
+		for (int fd : {row_fd, column_fd}) {
+			int ret = fcntl(fd, F_SETFL, read_mode);
+			assert(ret==0);
+		}
 
 		int fin;
 		long offset = 0;
+		bool pipelined;
+		call_hit_bytes = 0;
+		call_miss_bytes = 0;
+		double call_start_time = get_time();
+		if (stats_out!=NULL) {
+			for (auto & stats : thread_stats) stats.clear();
+		}
 		switch(update_mode) {
-		case 0: // source oriented update
-			threads.clear();
-			for (int ti=0;ti<parallelism;ti++) {
-				threads.emplace_back([&](int thread_id){
-					T local_value = zero;
-					long local_read_bytes = 0;
-					while (true) {
-						int fin;
-						long offset, length;
-						std::tie(fin, offset, length) = tasks.pop();
-						if (fin==-1) break;
-						char * buffer = buffer_pool[thread_id];
-						long bytes = pread(fin, buffer, length, offset);
-						assert(bytes>0);
-						local_read_bytes += bytes;
-						// CHECK: start position should be offset % edge_unit
-						for (long pos=offset % edge_unit;pos+edge_unit<=bytes;pos+=edge_unit) {
-							Edge & e = *(Edge*)(buffer+pos);
-							if (bitmap==nullptr || bitmap->get_bit(e.source)) {
-								local_value += process(e);
-							}
-						}
-					}
-					write_add(&value, local_value);
-					write_add(&read_bytes, local_read_bytes);
-				}, ti);
-			}
-			fin = open((path+"/row").c_str(), read_mode);
+		case 0: // source oriented update; targets are scattered over all nodes, so there is no affinity to keep
+			pool->start([&](int thread_id){
+				stream_queued_chunks(thread_id, process, bitmap, target_bitmap, 0, vertices, zero, value, read_bytes, tasks);
+			});
+			fin = row_fd;
 			posix_fadvise(fin, 0, 0, POSIX_FADV_SEQUENTIAL);
+			cached_fd = fin;
+			cached_layout = 0;
 			for (int i=0;i<partitions;i++) {
 				if (!should_access_shard[i]) continue;
 				for (int j=0;j<partitions;j++) {
-					long begin_offset = row_offset[i*partitions+j];
-					if (begin_offset - offset >= PAGESIZE) {
-						offset = begin_offset / PAGESIZE * PAGESIZE;
-					}
-					long end_offset = row_offset[i*partitions+j+1];
-					if (end_offset <= offset) continue;
-					while (end_offset - offset >= IOSIZE) {
-						tasks.push(std::make_tuple(fin, offset, IOSIZE));
-						offset += IOSIZE;
-					}
-					if (end_offset > offset) {
-						tasks.push(std::make_tuple(fin, offset, (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE));
-						offset += (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
-					}
+					if (!should_access_block[i*partitions+j]) continue;
+					split_block(row_offset[i*partitions+j], row_offset[i*partitions+j+1], offset, [&](long chunk_offset, long length){
+						tasks->push(std::make_tuple(fin, chunk_offset, length));
+					});
+					split_delta(i, j, [&](int fd, long chunk_offset, long length){
+						tasks->push(std::make_tuple(fd, chunk_offset, length));
+					});
 				}
 			}
 			for (int i=0;i<parallelism;i++) {
-				tasks.push(std::make_tuple(-1, 0, 0));
-			}
-			for (int i=0;i<parallelism;i++) {
-				threads[i].join();
+				tasks->push(std::make_tuple(-1, 0, 0));
 			}
+			pool->wait();
 			break;
 		case 1: // target oriented update
-			fin = open((path+"/column").c_str(), read_mode);
+			fin = column_fd;
 			posix_fadvise(fin, 0, 0, POSIX_FADV_SEQUENTIAL);
+			cached_fd = fin;
+			cached_layout = 1;
 
+			pipelined = begin_pipeline();
 			for (int cur_partition=0;cur_partition<partitions;cur_partition+=partition_batch) {
 				VertexId begin_vid, end_vid;
-				begin_vid = get_partition_range(vertices, partitions, cur_partition).first;
-				if (cur_partition+partition_batch>=partitions) {
-					end_vid = vertices;
-				} else {
-					end_vid = get_partition_range(vertices, partitions, cur_partition+partition_batch).first;
-				}
+				std::tie(begin_vid, end_vid) = window_range(cur_partition, partition_batch);
 				pre_source_window(std::make_pair(begin_vid, end_vid));
+				if (pipelined && cur_partition+partition_batch<partitions) {
+					prefetch_window(window_range(cur_partition+partition_batch, partition_batch));
+				}
 				// printf("pre %d %d\n", begin_vid, end_vid);
-				threads.clear();
-				for (int ti=0;ti<parallelism;ti++) {
-					threads.emplace_back([&](int thread_id){
-						T local_value = zero;
-						long local_read_bytes = 0;
-						while (true) {
-							int fin;
-							long offset, length;
-							std::tie(fin, offset, length) = tasks.pop();
-							if (fin==-1) break;
-							char * buffer = buffer_pool[thread_id];
-							long bytes = pread(fin, buffer, length, offset);
-							assert(bytes>0);
-							local_read_bytes += bytes;
-							// CHECK: start position should be offset % edge_unit
-							for (long pos=offset % edge_unit;pos+edge_unit<=bytes;pos+=edge_unit) {
-								Edge & e = *(Edge*)(buffer+pos);
-								if (e.source < begin_vid || e.source >= end_vid) {
-									continue;
-								}
-								if (bitmap==nullptr || bitmap->get_bit(e.source)) {
-									local_value += process(e);
-								}
-							}
+				if (numa_domains==1) {
+					pool->start([&](int thread_id){
+						stream_queued_chunks(thread_id, process, bitmap, target_bitmap, begin_vid, end_vid, zero, value, read_bytes, tasks);
+					});
+					offset = 0;
+					for (int j=0;j<partitions;j++) {
+						for (int i=cur_partition;i<cur_partition+partition_batch;i++) {
+							if (i>=partitions) break;
+							if (!should_access_block[i*partitions+j]) continue;
+							split_block(column_offset[j*partitions+i], column_offset[j*partitions+i+1], offset, [&](long chunk_offset, long length){
+								tasks->push(std::make_tuple(fin, chunk_offset, length));
+							});
+							split_delta(i, j, [&](int fd, long chunk_offset, long length){
+								tasks->push(std::make_tuple(fd, chunk_offset, length));
+							});
 						}
-						write_add(&value, local_value);
-						write_add(&read_bytes, local_read_bytes);
-					}, ti);
-				}
-				offset = 0;
-				for (int j=0;j<partitions;j++) {
-					for (int i=cur_partition;i<cur_partition+partition_batch;i++) {
-						if (i>=partitions) break;
-						if (!should_access_shard[i]) continue;
-						long begin_offset = column_offset[j*partitions+i];
-						if (begin_offset - offset >= PAGESIZE) {
-							offset = begin_offset / PAGESIZE * PAGESIZE;
+					}
+					for (int i=0;i<parallelism;i++) {
+						tasks->push(std::make_tuple(-1, 0, 0));
+					}
+				} else {
+					// the chunks of a column go to the queue of the node owning it, and are fed round-robin over
+					// the nodes so that a full queue does not leave the other nodes idle
+					// (one running offset, as above: a page shared by two columns is read once)
+					std::vector<std::vector<std::tuple<int, long, long> > > node_chunks(numa_domains);
+					offset = 0;
+					for (int j=0;j<partitions;j++) {
+						std::vector<std::tuple<int, long, long> > & chunks = node_chunks[partition_node(j, partitions, numa_domains)];
+						for (int i=cur_partition;i<cur_partition+partition_batch;i++) {
+							if (i>=partitions) break;
+							if (!should_access_block[i*partitions+j]) continue;
+							split_block(column_offset[j*partitions+i], column_offset[j*partitions+i+1], offset, [&](long chunk_offset, long length){
+								chunks.push_back(std::make_tuple(fin, chunk_offset, length));
+							});
+							split_delta(i, j, [&](int fd, long chunk_offset, long length){
+								chunks.push_back(std::make_tuple(fd, chunk_offset, length));
+							});
 						}
-						long end_offset = column_offset[j*partitions+i+1];
-						if (end_offset <= offset) continue;
-						while (end_offset - offset >= IOSIZE) {
-							tasks.push(std::make_tuple(fin, offset, IOSIZE));
-							offset += IOSIZE;
+					}
+					pool->start([&](int thread_id){
+						stream_queued_chunks(thread_id, process, bitmap, target_bitmap, begin_vid, end_vid, zero, value, read_bytes, domain_tasks[worker_domain[thread_id]]);
+					});
+					for (size_t k=0;;k++) {
+						bool pushed = false;
+						for (int d=0;d<numa_domains;d++) {
+							if (k < node_chunks[d].size()) {
+								domain_tasks[d]->push(node_chunks[d][k]);
+								pushed = true;
+							}
 						}
-						if (end_offset > offset) {
-							tasks.push(std::make_tuple(fin, offset, (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE));
-							offset += (end_offset - offset + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+						if (!pushed) break;
+					}
+					for (int d=0;d<numa_domains;d++) {
+						for (int t=0;t<domain_workers[d];t++) {
+							domain_tasks[d]->push(std::make_tuple(-1, 0, 0));
 						}
 					}
 				}
-				for (int i=0;i<parallelism;i++) {
-					tasks.push(std::make_tuple(-1, 0, 0));
+				pool->wait();
+				post_source_window(std::make_pair(begin_vid, end_vid));
+				// printf("post %d %d\n", begin_vid, end_vid);
+			}
+			if (pipelined) end_pipeline();
+
+			break;
+		case 2: // target oriented update, every column is processed by exactly one thread
+			fin = column_fd;
+			posix_fadvise(fin, 0, 0, POSIX_FADV_SEQUENTIAL);
+			cached_fd = fin;
+			cached_layout = 1;
+
+			pipelined = begin_pipeline();
+			for (int cur_partition=0;cur_partition<partitions;cur_partition+=partition_batch) {
+				VertexId begin_vid, end_vid;
+				std::tie(begin_vid, end_vid) = window_range(cur_partition, partition_batch);
+				pre_source_window(std::make_pair(begin_vid, end_vid));
+				if (pipelined && cur_partition+partition_batch<partitions) {
+					prefetch_window(window_range(cur_partition+partition_batch, partition_batch));
+				}
+				// hand out the largest columns first so that the last ones to finish are small
+				std::vector<std::pair<long, int> > columns;
+				for (int j=0;j<partitions;j++) {
+					long bytes = 0;
+					for (int i=cur_partition;i<cur_partition+partition_batch && i<partitions;i++) {
+						if (should_access_block[i*partitions+j]) bytes += fsize[i][j];
+					}
+					columns.push_back(std::make_pair(-bytes, j));
 				}
-				for (int i=0;i<parallelism;i++) {
-					threads[i].join();
+				std::sort(columns.begin(), columns.end());
+				std::vector<int> order;
+				for (auto & column : columns) {
+					order.push_back(column.second);
 				}
+				PartitionQueue queue = partition_queue(order);
+				pool->run([&](int thread_id){
+					T local_value = zero;
+					long local_read_bytes = 0;
+					int j;
+					while ((j = queue.pop(worker_domain[thread_id]))!=-1) {
+						std::vector<std::tuple<int, long, long> > chunks;
+						long offset = 0;
+						for (int i=cur_partition;i<cur_partition+partition_batch && i<partitions;i++) {
+							if (!should_access_block[i*partitions+j]) continue;
+							split_block(column_offset[j*partitions+i], column_offset[j*partitions+i+1], offset, [&](long chunk_offset, long length){
+								chunks.push_back(std::make_tuple(fin, chunk_offset, length));
+							});
+							split_delta(i, j, [&](int fd, long chunk_offset, long length){
+								chunks.push_back(std::make_tuple(fd, chunk_offset, length));
+							});
+						}
+						std::pair<VertexId,VertexId> target_vid_range = get_partition_range(vertices, partitions, j);
+						pre_target_window(target_vid_range);
+						size_t cursor = 0;
+						stream_chunks(thread_id, process, bitmap, target_bitmap, begin_vid, end_vid, target_vid_range.first, target_vid_range.second, local_value, local_read_bytes,
+							[&](bool wait, std::tuple<int, long, long> & task){
+								if (cursor==chunks.size()) {
+									task = std::make_tuple(-1, 0, 0);
+								} else {
+									task = chunks[cursor++];
+								}
+								return true;
+							}
+						);
+						post_target_window(target_vid_range);
+					}
+					write_add(&value, local_value);
+					write_add(&read_bytes, local_read_bytes);
+				});
 				post_source_window(std::make_pair(begin_vid, end_vid));
-				// printf("post %d %d\n", begin_vid, end_vid);
 			}
+			if (pipelined) end_pipeline();
 
 			break;
 		default:
 			assert(false);
 		}
 
-		close(fin);
-		// printf("streamed %ld bytes of edges\n", read_bytes);
+		cached_fd = -1;
+		if (stats_out!=NULL) {
+			int blocks = 0;
+			for (int ij=0;ij<partitions*partitions;ij++) {
+				blocks += should_access_block[ij];
+			}
+			write_stats(stats_out, stats_calls++, update_mode, get_time() - call_start_time, read_bytes, skipped_bytes, call_hit_bytes, cache_unpinned_bytes(), blocks, thread_stats);
+		}
+		total_read_bytes += read_bytes;
+		total_skipped_bytes += skipped_bytes;
 		return value;
 	}
 };
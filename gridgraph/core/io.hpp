@@ -0,0 +1,190 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef IO_H
+#define IO_H
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <deque>
+
+#define IO_PREAD 0
+#define IO_URING 1
+
+// a per-thread queue of outstanding reads, served by io_uring when the kernel allows it (including IORING_OP_READ)
+// and by pread otherwise
+class AsyncReader {
+	struct Request {
+		int fd;
+		char * buffer;
+		long length;
+		long offset;
+		unsigned long tag;
+	};
+	int ring_fd;
+	unsigned depth;
+	unsigned inflight;
+	std::deque<Request> pending; // pread fallback
+
+	void * sq_ptr;
+	void * cq_ptr;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+	struct io_uring_sqe * sqes;
+	size_t sqes_size;
+	unsigned * sq_head;
+	unsigned * sq_tail;
+	unsigned * sq_mask;
+	unsigned * sq_array;
+	unsigned * cq_head;
+	unsigned * cq_tail;
+	unsigned * cq_mask;
+	struct io_uring_cqe * cqes;
+
+	bool setup_ring() {
+		struct io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		ring_fd = syscall(__NR_io_uring_setup, depth, &params);
+		if (ring_fd < 0) return false;
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if (single_mmap) {
+			if (cq_ring_size > sq_ring_size) sq_ring_size = cq_ring_size;
+			cq_ring_size = sq_ring_size;
+		}
+		sq_ptr = mmap(0, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+		if (sq_ptr==MAP_FAILED) {
+			close(ring_fd);
+			return false;
+		}
+		if (single_mmap) {
+			cq_ptr = sq_ptr;
+		} else {
+			cq_ptr = mmap(0, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+			assert(cq_ptr!=MAP_FAILED);
+		}
+		sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+		sqes = (struct io_uring_sqe *)mmap(0, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+		assert(sqes!=MAP_FAILED);
+		sq_head = (unsigned *)((char *)sq_ptr + params.sq_off.head);
+		sq_tail = (unsigned *)((char *)sq_ptr + params.sq_off.tail);
+		sq_mask = (unsigned *)((char *)sq_ptr + params.sq_off.ring_mask);
+		sq_array = (unsigned *)((char *)sq_ptr + params.sq_off.array);
+		cq_head = (unsigned *)((char *)cq_ptr + params.cq_off.head);
+		cq_tail = (unsigned *)((char *)cq_ptr + params.cq_off.tail);
+		cq_mask = (unsigned *)((char *)cq_ptr + params.cq_off.ring_mask);
+		cqes = (struct io_uring_cqe *)((char *)cq_ptr + params.cq_off.cqes);
+		if (!supports_read()) {
+			release_ring();
+			return false;
+		}
+		return true;
+	}
+	// IORING_OP_READ appeared in Linux 5.6 together with the probe; an older kernel fails the probe itself
+	bool supports_read() {
+		size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+		struct io_uring_probe * probe = (struct io_uring_probe *)calloc(1, probe_size);
+		assert(probe!=NULL);
+		int ret = syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, 256);
+		bool supported = ret==0 && probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+		free(probe);
+		return supported;
+	}
+	void release_ring() {
+		munmap(sqes, sqes_size);
+		if (cq_ptr!=sq_ptr) munmap(cq_ptr, cq_ring_size);
+		munmap(sq_ptr, sq_ring_size);
+		close(ring_fd);
+		ring_fd = -1;
+	}
+public:
+	AsyncReader(unsigned depth, int backend = IO_URING) : depth(depth) {
+		inflight = 0;
+		ring_fd = -1;
+		if (backend==IO_URING && !setup_ring()) {
+			ring_fd = -1;
+		}
+	}
+	~AsyncReader() {
+		if (ring_fd!=-1) {
+			release_ring();
+		}
+	}
+	bool uses_uring() {
+		return ring_fd!=-1;
+	}
+	unsigned outstanding() {
+		return inflight;
+	}
+	void submit(int fd, char * buffer, long length, long offset, unsigned long tag) {
+		assert(inflight < depth);
+		inflight++;
+		if (ring_fd==-1) {
+			Request request = {fd, buffer, length, offset, tag};
+			pending.push_back(request);
+			return;
+		}
+		unsigned tail = *sq_tail;
+		unsigned index = tail & *sq_mask;
+		struct io_uring_sqe * sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (unsigned long)buffer;
+		sqe->len = length;
+		sqe->off = offset;
+		sqe->user_data = tag;
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		int ret;
+		do {
+			ret = syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, NULL, 0);
+		} while (ret==-1 && errno==EINTR);
+		assert(ret==1);
+	}
+	// block until one outstanding read finishes; returns its byte count (or -errno) and tag
+	long wait(unsigned long & tag) {
+		assert(inflight > 0);
+		inflight--;
+		if (ring_fd==-1) {
+			Request request = pending.front();
+			pending.pop_front();
+			tag = request.tag;
+			return pread(request.fd, request.buffer, request.length, request.offset);
+		}
+		while (true) {
+			unsigned head = *cq_head;
+			if (head!=__atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+				struct io_uring_cqe * cqe = &cqes[head & *cq_mask];
+				tag = cqe->user_data;
+				long res = cqe->res;
+				__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+				return res;
+			}
+			syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,165 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef MSBFS_H
+#define MSBFS_H
+
+#include <vector>
+
+#include "core/graph.hpp"
+
+// a set of up to W sources, one bit each. the word loops are plain so that the compiler turns them into
+// SIMD and/andnot/or (W = 256 is one AVX2 register)
+template <int W>
+struct SourceSet {
+	static_assert(W % 64 == 0, "W must be a multiple of 64");
+	unsigned long word[W / 64];
+
+	void clear() {
+		for (int w=0;w<W/64;w++) word[w] = 0;
+	}
+	void set(int k) {
+		word[k >> 6] |= 1ul << (k & 63);
+	}
+	bool get(int k) const {
+		return (word[k >> 6] >> (k & 63)) & 1;
+	}
+	bool any() const {
+		unsigned long bits = 0;
+		for (int w=0;w<W/64;w++) bits |= word[w];
+		return bits!=0;
+	}
+	int count() const {
+		int bits = 0;
+		for (int w=0;w<W/64;w++) bits += __builtin_popcountl(word[w]);
+		return bits;
+	}
+};
+
+// breadth-first search from up to W sources at once (W = 64, 128 or 256): each level is a single edge pass
+// in which every edge carries the set of sources that reached its source vertex at the previous level.
+// a batch of point queries thus costs about one BFS of the deepest source.
+template <int W>
+class MultiSourceBFS {
+	Graph & graph;
+	Frontier * active_in;
+	Frontier * active_out;
+public:
+	BigVector<SourceSet<W> > seen; // the sources that reached each vertex
+	BigVector<SourceSet<W> > frontier; // the sources that reached each vertex at the last level
+	BigVector<SourceSet<W> > next;
+
+	MultiSourceBFS(Graph & graph) : graph(graph),
+		seen(graph.path+"/msbfs_seen", graph.vertices),
+		frontier(graph.path+"/msbfs_frontier", graph.vertices),
+		next(graph.path+"/msbfs_next", graph.vertices) {
+		active_in = graph.alloc_frontier();
+		active_out = graph.alloc_frontier();
+	}
+	~MultiSourceBFS() {
+		delete active_in;
+		delete active_out;
+	}
+
+	// source k is sources[k]. visit(v, level, reached) is called, possibly in parallel, once for every vertex and
+	// level at which some sources reach it first; reached holds those sources. returns the number of levels
+	template <typename F>
+	int run(const std::vector<VertexId> & sources, F visit) {
+		assert(sources.size() <= (size_t)W);
+		graph.stream_vertices<VertexId>([&](VertexId i){
+			seen[i].clear();
+			frontier[i].clear();
+			next[i].clear();
+			return 0;
+		});
+		active_out->clear();
+		for (size_t k=0;k<sources.size();k++) {
+			seen[sources[k]].set(k);
+			frontier[sources[k]].set(k);
+			active_out->add(sources[k]);
+		}
+		graph.stream_vertices<VertexId>([&](VertexId i){
+			visit(i, 0, frontier[i]);
+			return 0;
+		}, *active_out);
+
+		int level = 0;
+		while (active_out->size()!=0) {
+			level++;
+			std::swap(active_in, active_out);
+			active_out->clear();
+			graph.hint(seen, frontier, next);
+			graph.traverse<VertexId>([&](UnweightedEdge & e){
+				const SourceSet<W> & from = frontier[e.source];
+				const SourceSet<W> & known = seen[e.target];
+				SourceSet<W> reached;
+				for (int w=0;w<W/64;w++) reached.word[w] = from.word[w] & ~known.word[w];
+				if (!reached.any()) return 0;
+				SourceSet<W> & to = next[e.target];
+				for (int w=0;w<W/64;w++) {
+					if ((reached.word[w] & ~to.word[w])!=0) __sync_fetch_and_or(&to.word[w], reached.word[w]);
+				}
+				active_out->add(e.target);
+				return 1;
+			}, *active_in);
+			// the previous level's frontier is spent; the new one is what arrived during this pass
+			graph.stream_vertices<VertexId>([&](VertexId i){
+				frontier[i].clear();
+				return 0;
+			}, *active_in);
+			graph.stream_vertices<VertexId>([&](VertexId i){
+				SourceSet<W> & arrived = next[i];
+				for (int w=0;w<W/64;w++) {
+					seen[i].word[w] |= arrived.word[w];
+					frontier[i].word[w] = arrived.word[w];
+				}
+				arrived.clear();
+				visit(i, level, frontier[i]);
+				return 0;
+			}, *active_out);
+		}
+		return std::max(level - 1, 0);
+	}
+
+	// whether sources[k] of the last run reached v
+	bool reached(VertexId v, int k) {
+		return seen[v].get(k);
+	}
+
+	// the hop distance from every source to every target, -1 if unreachable: distances[k * targets.size() + t]
+	std::vector<int> distances(const std::vector<VertexId> & sources, const std::vector<VertexId> & targets) {
+		std::vector<int> distances(sources.size() * targets.size(), -1);
+		Bitmap is_target(graph.vertices);
+		std::vector<std::pair<VertexId, size_t> > index;
+		for (size_t t=0;t<targets.size();t++) {
+			is_target.set_bit(targets[t]);
+			index.push_back(std::make_pair(targets[t], t));
+		}
+		std::sort(index.begin(), index.end());
+		run(sources, [&](VertexId v, int level, const SourceSet<W> & reached){
+			if (!is_target.get_bit(v)) return;
+			auto it = std::lower_bound(index.begin(), index.end(), std::make_pair(v, (size_t)0));
+			for (;it!=index.end() && it->first==v;it++) {
+				for (size_t k=0;k<sources.size();k++) {
+					if (reached.get(k)) distances[k * targets.size() + it->second] = level;
+				}
+			}
+		});
+		return distances;
+	}
+};
+
+#endif
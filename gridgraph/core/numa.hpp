@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#include "core/threadpool.hpp"
+
+// memory policies are set with the raw mbind system call, so no libnuma is needed
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1<<1)
+#endif
+
+#define MAX_NUMA_NODES 64
+
+// read a list of ids in ranges such as "0-3,8-11" (the format of the sysfs node and cpu lists); empty if unreadable
+inline std::vector<int> read_id_list(const char * filename) {
+	std::vector<int> ids;
+	FILE * fin = fopen(filename, "r");
+	if (fin==NULL) return ids;
+	int first, last;
+	while (fscanf(fin, "%d", &first)==1) {
+		last = first;
+		int c = fgetc(fin);
+		if (c=='-') {
+			if (fscanf(fin, "%d", &last)!=1) break;
+			c = fgetc(fin);
+		}
+		for (int id=first;id<=last;id++) {
+			ids.push_back(id);
+		}
+		if (c!=',') break;
+	}
+	fclose(fin);
+	return ids;
+}
+
+// the number of NUMA nodes (the highest online node + 1); 1 when the topology is unknown
+inline int numa_nodes() {
+	static int nodes = 0;
+	if (nodes==0) {
+		std::vector<int> online = read_id_list("/sys/devices/system/node/online");
+		int highest = online.empty() ? 0 : *std::max_element(online.begin(), online.end());
+		nodes = std::min(highest + 1, MAX_NUMA_NODES);
+	}
+	return nodes;
+}
+
+// the cpus of a node that this process may run on; on a machine without NUMA (or an unreadable topology) node 0
+// has every allowed cpu
+inline std::vector<int> numa_node_cpus(int node) {
+	char filename[64];
+	sprintf(filename, "/sys/devices/system/node/node%d/cpulist", node);
+	std::vector<int> node_cpus = read_id_list(filename);
+	std::vector<int> allowed = allowed_cpus();
+	if (node_cpus.empty()) {
+		return (node==0) ? allowed : node_cpus;
+	}
+	std::vector<int> cpus;
+	for (int cpu : node_cpus) {
+		if (std::find(allowed.begin(), allowed.end(), cpu)!=allowed.end()) cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+// the node that partition p of partitions belongs to: nodes own contiguous runs of partitions
+inline int partition_node(int p, int partitions, int nodes) {
+	return (long)p * nodes / partitions;
+}
+
+// set the policy of the pages in [addr, addr+bytes), moving pages that are already resident; addr must be page aligned
+inline bool numa_policy(void * addr, size_t bytes, int mode, unsigned long nodemask) {
+	if (bytes==0) return true;
+	return syscall(SYS_mbind, addr, bytes, mode, &nodemask, (unsigned long)MAX_NUMA_NODES + 1, MPOL_MF_MOVE)==0;
+}
+
+// spread the pages round-robin over all nodes
+inline bool numa_interleave(void * addr, size_t bytes) {
+	int nodes = numa_nodes();
+	if (nodes<=1) return true;
+	return numa_policy(addr, bytes, MPOL_INTERLEAVE, nodes==64 ? ~0ul : (1ul << nodes) - 1);
+}
+
+// place the pages on one node, falling back to others when it is full
+inline bool numa_prefer(void * addr, size_t bytes, int node) {
+	if (numa_nodes()<=1) return true;
+	return numa_policy(addr, bytes, MPOL_PREFERRED, 1ul << node);
+}
+
+#endif
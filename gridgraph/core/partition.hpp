@@ -17,6 +17,8 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #ifndef PARTITION_H
 #define PARTITION_H
 
+#include <vector>
+
 inline size_t get_partition_id(const size_t vertices, const size_t partitions, const size_t vertex_id) {
         if (vertices % partitions==0) {
                 const size_t partition_size = vertices / partitions;
@@ -41,4 +43,40 @@ inline std::pair<size_t, size_t> get_partition_range(const size_t vertices, cons
         return std::make_pair(begin, end);
 }
 
+// hands out items (partitions or columns) to workers of several domains, such as NUMA nodes. a worker takes
+// the items of its own domain first, then helps the other domains with theirs
+class PartitionQueue {
+	std::vector<int> items; // grouped by domain, each group in the order given
+	std::vector<int> next;
+	std::vector<int> end;
+public:
+	// item_domains[k]: the domain of items[k]
+	PartitionQueue(const std::vector<int> & items, const std::vector<int> & item_domains, int domains) : next(domains + 1, 0), end(domains, 0) {
+		for (size_t k=0;k<items.size();k++) {
+			next[item_domains[k]+1]++;
+		}
+		for (int d=0;d<domains;d++) {
+			next[d+1] += next[d];
+			end[d] = next[d+1];
+		}
+		next.pop_back();
+		this->items.resize(items.size());
+		std::vector<int> cursor(next);
+		for (size_t k=0;k<items.size();k++) {
+			this->items[cursor[item_domains[k]]++] = items[k];
+		}
+	}
+	// the next item for a worker of domain, -1 once every item is taken
+	int pop(int domain) {
+		int domains = end.size();
+		for (int k=0;k<domains;k++) {
+			int d = (domain + k) % domains;
+			if (next[d] >= end[d]) continue;
+			int position = __sync_fetch_and_add(&next[d], 1);
+			if (position < end[d]) return items[position];
+		}
+		return -1;
+	}
+};
+
 #endif
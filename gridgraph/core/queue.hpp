@@ -17,9 +17,13 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #ifndef QUEUE_H
 #define QUEUE_H
 
+#include <sched.h>
+#include <time.h>
+
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 
 template <typename T>
 class Queue {
@@ -46,6 +50,15 @@ public:
 		cond_full.notify_one();
 		return item;
 	}
+	bool try_pop(T & item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (is_empty()) return false;
+		item = queue.front();
+		queue.pop();
+		lock.unlock();
+		cond_full.notify_one();
+		return true;
+	}
 	bool is_full() {
 		return queue.size()==capacity;
 	}
@@ -54,4 +67,141 @@ public:
 	}
 };
 
+// bounded multi-producer multi-consumer queue (Vyukov); push/pop spin instead of sleeping on a lock
+template <typename T>
+class LockFreeQueue {
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+	size_t capacity;
+	size_t mask;
+	Cell * buffer;
+	char pad0[64];
+	std::atomic<size_t> enqueue_pos;
+	char pad1[64];
+	std::atomic<size_t> dequeue_pos;
+	char pad2[64];
+
+	static void backoff(int & round) {
+		if (round < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+		} else if (round < 1024) {
+			sched_yield();
+		} else {
+			struct timespec ts = {0, 50000};
+			nanosleep(&ts, NULL);
+		}
+		round++;
+	}
+public:
+	LockFreeQueue(const size_t capacity) {
+		this->capacity = 2; // a single cell cannot tell full from empty
+		while (this->capacity < capacity) this->capacity <<= 1;
+		mask = this->capacity - 1;
+		buffer = new Cell [this->capacity];
+		for (size_t i=0;i<this->capacity;i++) {
+			buffer[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueue_pos.store(0, std::memory_order_relaxed);
+		dequeue_pos.store(0, std::memory_order_relaxed);
+	}
+	~LockFreeQueue() {
+		delete [] buffer;
+	}
+	bool try_push(const T & item) {
+		size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		while (true) {
+			Cell * cell = &buffer[pos & mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			long diff = (long)seq - (long)pos;
+			if (diff==0) {
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell->data = item;
+					cell->sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	bool try_pop(T & item) {
+		size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		while (true) {
+			Cell * cell = &buffer[pos & mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			long diff = (long)seq - (long)(pos + 1);
+			if (diff==0) {
+				if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					item = cell->data;
+					cell->sequence.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	void push(const T & item) {
+		int round = 0;
+		while (!try_push(item)) backoff(round);
+	}
+	T pop() {
+		T item;
+		int round = 0;
+		while (!try_pop(item)) backoff(round);
+		return item;
+	}
+};
+
+#define QUEUE_MUTEX 0
+#define QUEUE_LOCKFREE 1
+
+// task queue whose implementation is picked at runtime so both can be compared
+template <typename T>
+class TaskQueue {
+	Queue<T> * locked;
+	LockFreeQueue<T> * lockfree;
+public:
+	TaskQueue(const size_t capacity, int type = QUEUE_LOCKFREE) {
+		locked = NULL;
+		lockfree = NULL;
+		if (type==QUEUE_MUTEX) {
+			locked = new Queue<T>(capacity);
+		} else {
+			lockfree = new LockFreeQueue<T>(capacity);
+		}
+	}
+	~TaskQueue() {
+		delete locked;
+		delete lockfree;
+	}
+	void push(const T & item) {
+		if (lockfree!=NULL) {
+			lockfree->push(item);
+		} else {
+			locked->push(item);
+		}
+	}
+	T pop() {
+		if (lockfree!=NULL) {
+			return lockfree->pop();
+		}
+		return locked->pop();
+	}
+	bool try_pop(T & item) {
+		if (lockfree!=NULL) {
+			return lockfree->try_pop(item);
+		}
+		return locked->try_pop(item);
+	}
+};
+
 #endif
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// what one streaming worker did during a stream_edges call; times are in seconds
+struct StreamStats {
+	long bytes; // read from the grid
+	long chunks; // processed, cached ones included
+	long cached_chunks;
+	double read_wait; // blocked until a read completed
+	double kernel; // filtering and running the kernel over chunks
+	double queue_wait; // blocked on the task queue
+
+	void clear() {
+		bytes = 0;
+		chunks = 0;
+		cached_chunks = 0;
+		read_wait = 0;
+		kernel = 0;
+		queue_wait = 0;
+	}
+};
+
+// one JSON line per call: the totals, then every worker. skew is the busiest worker's read_wait + kernel
+// time over the mean, so 1 means an even split of the work
+inline void write_stats(FILE * out, long call, int update_mode, double seconds, long read_bytes, long skipped_bytes,
+	long cache_hit_bytes, long cache_unpinned_bytes, int blocks, const std::vector<StreamStats> & threads) {
+	double busiest = 0, total = 0;
+	for (auto & thread : threads) {
+		double busy = thread.read_wait + thread.kernel;
+		busiest = std::max(busiest, busy);
+		total += busy;
+	}
+	double skew = (total > 0) ? busiest * threads.size() / total : 1;
+	fprintf(out, "{\"call\":%ld,\"update_mode\":%d,\"seconds\":%.6f,\"read_bytes\":%ld,\"skipped_bytes\":%ld,\"cache_hit_bytes\":%ld,\"cache_unpinned_bytes\":%ld,\"blocks\":%d,\"skew\":%.3f,\"threads\":[",
+		call, update_mode, seconds, read_bytes, skipped_bytes, cache_hit_bytes, cache_unpinned_bytes, blocks, skew);
+	for (size_t t=0;t<threads.size();t++) {
+		const StreamStats & thread = threads[t];
+		fprintf(out, "%s{\"bytes\":%ld,\"chunks\":%ld,\"cached_chunks\":%ld,\"read_wait\":%.6f,\"kernel\":%.6f,\"queue_wait\":%.6f}",
+			t==0 ? "" : ",", thread.bytes, thread.chunks, thread.cached_chunks, thread.read_wait, thread.kernel, thread.queue_wait);
+	}
+	fprintf(out, "]}\n");
+	fflush(out);
+}
+
+#endif
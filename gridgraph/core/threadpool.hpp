@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "core/time.hpp"
+
+// id of the pool worker running the calling thread (-1 outside of a pool)
+inline int & worker_id() {
+	static thread_local int id = -1;
+	return id;
+}
+
+// the cpus this process may run on (its cpuset or taskset mask), which need not be 0..cores-1
+inline std::vector<int> allowed_cpus() {
+	std::vector<int> cpus;
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &cpuset)==0) {
+		for (int i=0;i<CPU_SETSIZE;i++) {
+			if (CPU_ISSET(i, &cpuset)) cpus.push_back(i);
+		}
+	}
+	if (cpus.empty()) {
+		int cores = std::thread::hardware_concurrency();
+		for (int i=0;i<cores;i++) {
+			cpus.push_back(i);
+		}
+	}
+	return cpus;
+}
+
+// a fixed set of long-lived workers; every job runs once on each worker
+class ThreadPool {
+	int threads;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable cond_start;
+	std::condition_variable cond_finish;
+	std::function<void(int)> job;
+	long generation;
+	int running;
+	bool stopping;
+	double issue_time;
+	double last_start_time;
+
+	void work(int thread_id) {
+		worker_id() = thread_id;
+		long seen = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cond_start.wait(lock, [&]{ return stopping || generation!=seen; });
+				if (stopping) break;
+				seen = generation;
+				double now = get_time();
+				if (now > last_start_time) last_start_time = now;
+			}
+			job(thread_id);
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				running--;
+				if (running==0) cond_finish.notify_all();
+			}
+		}
+	}
+public:
+	double startup_time; // seconds between issuing a job and the last worker picking it up
+	long jobs;
+
+	ThreadPool(int threads) : threads(threads) {
+		generation = 0;
+		running = 0;
+		stopping = false;
+		startup_time = 0;
+		jobs = 0;
+		for (int ti=0;ti<threads;ti++) {
+			workers.emplace_back(&ThreadPool::work, this, ti);
+		}
+	}
+	~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		cond_start.notify_all();
+		for (int ti=0;ti<threads;ti++) {
+			workers[ti].join();
+		}
+	}
+	int size() {
+		return threads;
+	}
+	// pin worker i to cpus[i % cpus.size()] (all allowed cpus if empty). pinning is only an optimization, so a
+	// cpu that can not be used leaves its worker unpinned with a warning
+	void pin(std::vector<int> cpus = std::vector<int>()) {
+		if (cpus.empty()) {
+			cpus = allowed_cpus();
+		}
+		for (int ti=0;ti<threads;ti++) {
+			cpu_set_t cpuset;
+			CPU_ZERO(&cpuset);
+			CPU_SET(cpus[ti % cpus.size()], &cpuset);
+			int ret = pthread_setaffinity_np(workers[ti].native_handle(), sizeof(cpu_set_t), &cpuset);
+			if (ret!=0) {
+				fprintf(stderr, "warning: can not pin worker %d to cpu %d: %s\n", ti, cpus[ti % cpus.size()], strerror(ret));
+			}
+		}
+	}
+	// hand a job to every worker and return immediately
+	void start(std::function<void(int)> job) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			assert(running==0);
+			this->job = job;
+			running = threads;
+			generation++;
+			issue_time = get_time();
+			last_start_time = issue_time;
+		}
+		cond_start.notify_all();
+	}
+	// block until every worker has finished the current job
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		cond_finish.wait(lock, [&]{ return running==0; });
+		startup_time += last_start_time - issue_time;
+		jobs++;
+	}
+	void run(std::function<void(int)> job) {
+		start(job);
+		wait();
+	}
+};
+
+#endif
@@ -17,13 +17,25 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #ifndef TYPE_H
 #define TYPE_H
 
+// build with -DGRIDGRAPH_VERTEX64 (make VERTEX64=1) for graphs with 2^31 or more vertices; a grid records
+// the id width it was generated with in meta and can only be read by a build of the same width
+#ifdef GRIDGRAPH_VERTEX64
+typedef long VertexId;
+#else
 typedef int VertexId;
+#endif
 typedef long EdgeId;
 typedef float Weight;
 
-struct Edge {
+// the record of an unweighted grid (edge types 0 and 2); kernels that take an UnweightedEdge & run on
+// both layouts without copying. 4-byte aligned so that weighted records with 64-bit ids take 20 bytes
+struct __attribute__((packed, aligned(4))) UnweightedEdge {
 	VertexId source;
 	VertexId target;
+};
+
+// the record of a weighted grid (edge types 1 and 3)
+struct Edge : UnweightedEdge {
 	Weight weight;
 };
 
@@ -17,51 +17,61 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include "core/graph.hpp"
 
 int main(int argc, char ** argv) {
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
 	if (argc<3) {
-		fprintf(stderr, "usage: bfs [path] [start vertex id] [memory budget in GB]\n");
+		fprintf(stderr, "usage: bfs [path] [start vertex id] [memory budget in GB] [--stats=file] [--numa=1]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
-	VertexId start_vid = atoi(argv[2]);
+	VertexId start_vid = atol(argv[2]);
 	long memory_bytes = (argc>=4)?atol(argv[3])*1024l*1024l*1024l:8l*1024l*1024l*1024l;
 
 	Graph graph(path);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
 	graph.set_memory_bytes(memory_bytes);
-	Bitmap * active_in = graph.alloc_bitmap();
-	Bitmap * active_out = graph.alloc_bitmap();
+	Frontier * active_in = graph.alloc_frontier();
+	Frontier * active_out = graph.alloc_frontier();
+	Bitmap * unvisited = graph.alloc_bitmap();
 	BigVector<VertexId> parent(graph.path+"/parent", graph.vertices);
 	graph.set_vertex_data_bytes( graph.vertices * sizeof(VertexId) );
 
-	active_out->clear();
-	active_out->set_bit(start_vid);
+	active_out->add(start_vid);
 	parent.fill(-1);
 	parent[start_vid] = start_vid;
+	unvisited->fill();
+	unvisited->clear_bit(start_vid);
 	VertexId active_vertices = 1;
 
 	double start_time = get_time();
 	int iteration = 0;
 	while (active_vertices!=0) {
 		iteration++;
-		printf("%7d: %d\n", iteration, active_vertices);
 		std::swap(active_in, active_out);
 		active_out->clear();
 		graph.hint(parent);
-		active_vertices = graph.stream_edges<VertexId>([&](Edge & e){
+		VertexId frontier = active_vertices;
+		active_vertices = graph.traverse<VertexId>([&](UnweightedEdge & e){
 			if (parent[e.target]==-1) {
 				if (cas(&parent[e.target], -1, e.source)) {
-					active_out->set_bit(e.target);
+					unvisited->clear_bit(e.target);
+					active_out->add(e.target);
 					return 1;
 				}
 			}
 			return 0;
-		}, active_in);
+		}, *active_in, unvisited);
+		printf("%7d: %ld (%s)\n", iteration, (long)frontier, graph.last_direction()==PUSH?"push":"pull");
 	}
 	double end_time = get_time();
 
-	int discovered_vertices = graph.stream_vertices<VertexId>([&](VertexId i){
+	VertexId discovered_vertices = graph.stream_vertices<VertexId>([&](VertexId i){
 		return parent[i]!=-1;
 	});
-	printf("discovered %d vertices from %d in %.2f seconds.\n", discovered_vertices, start_vid, end_time - start_time);
+	printf("discovered %ld vertices from %ld in %.2f seconds.\n", (long)discovered_vertices, (long)start_vid, end_time - start_time);
+	printf("streamed %ld bytes of edges, skipped %ld bytes of inactive blocks\n", graph.streamed_bytes(), graph.skipped_bytes());
+	printf("thread startup overhead: %.3f ms per call over %ld calls\n", graph.stream_startup_time() * 1e3, graph.stream_calls());
 
 	return 0;
 }
@@ -16,75 +16,213 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 
 #include "core/graph.hpp"
 
-#include <unordered_map>
-
-struct LabelCounts {
-  std::unordered_map<int, int> counts;
-  std::mutex mutex;
-  void add(int label) {
-    std::lock_guard<std::mutex> lock(mutex);
-    counts[label]++;
-  }
+typedef std::pair<VertexId, VertexId> LabelKey; // (target, label of an in-neighbour)
+typedef std::pair<LabelKey, VertexId> LabelCount;
+
+// per-thread buffer of the (target, label) pairs seen in the column the thread currently owns
+struct LabelBuffer {
+	int column;
+	std::vector<LabelKey> keys;
+};
+
+// fold the sorted run of keys into the sorted histogram of a column
+void merge_counts(std::vector<LabelKey> & keys, std::vector<LabelCount> & counts) {
+	std::sort(keys.begin(), keys.end());
+	std::vector<LabelCount> merged;
+	merged.reserve(counts.size() + keys.size());
+	size_t a = 0, b = 0;
+	while (a<counts.size() || b<keys.size()) {
+		LabelCount next;
+		if (b==keys.size() || (a<counts.size() && counts[a].first<=keys[b])) {
+			next = counts[a++];
+		} else {
+			next = std::make_pair(keys[b++], 1);
+		}
+		if (!merged.empty() && merged.back().first==next.first) {
+			merged.back().second += next.second;
+		} else {
+			merged.push_back(next);
+		}
+	}
+	counts.swap(merged);
+	keys.clear();
+}
+
+// the histograms of a column from earlier source windows, spilled as sorted runs to an unlinked file, so that
+// only the window in flight is held in memory
+struct LabelSpill {
+	int fd;
+	long records;
+	std::vector<std::pair<long, long> > runs; // (first record, records)
 };
 
+const long SPILL_BUFFER = 65536; // records read at a time from every run while merging
+
+void spill_counts(LabelSpill & spill, std::vector<LabelCount> & counts) {
+	if (counts.empty()) return;
+	long bytes = sizeof(LabelCount) * counts.size();
+	for (long offset=0;offset<bytes;) {
+		long written = pwrite(spill.fd, (char *)counts.data() + offset, bytes - offset, sizeof(LabelCount) * spill.records + offset);
+		assert(written>0);
+		offset += written;
+	}
+	spill.runs.push_back(std::make_pair(spill.records, (long)counts.size()));
+	spill.records += counts.size();
+	std::vector<LabelCount>().swap(counts);
+}
+
+// merge the spilled runs of a column with the histogram in memory; visit(target, label, count) is called once
+// per (target, label) in sorted order. the runs are then dropped
+template <typename F>
+void merge_spilled(LabelSpill & spill, std::vector<LabelCount> & counts, F visit) {
+	struct Run {
+		std::vector<LabelCount> buffer;
+		size_t position;
+		long next; // the next record in the file
+		long end;
+	};
+	std::vector<Run> runs(spill.runs.size() + 1);
+	for (size_t r=0;r<spill.runs.size();r++) {
+		runs[r].next = spill.runs[r].first;
+		runs[r].end = spill.runs[r].first + spill.runs[r].second;
+		runs[r].position = 0;
+	}
+	runs.back().buffer.swap(counts);
+	runs.back().position = 0;
+	runs.back().next = runs.back().end = 0;
+	auto refill = [&](Run & run){
+		if (run.position<run.buffer.size() || run.next==run.end) return;
+		long records = std::min(SPILL_BUFFER, run.end - run.next);
+		run.buffer.resize(records);
+		long bytes = sizeof(LabelCount) * records;
+		for (long offset=0;offset<bytes;) {
+			long read_bytes = pread(spill.fd, (char *)run.buffer.data() + offset, bytes - offset, sizeof(LabelCount) * run.next + offset);
+			assert(read_bytes>0);
+			offset += read_bytes;
+		}
+		run.next += records;
+		run.position = 0;
+	};
+	while (true) {
+		Run * first = NULL;
+		for (auto & run : runs) {
+			refill(run);
+			if (run.position==run.buffer.size()) continue;
+			if (first==NULL || run.buffer[run.position].first<first->buffer[first->position].first) first = &run;
+		}
+		if (first==NULL) break;
+		LabelKey key = first->buffer[first->position].first;
+		VertexId count = 0;
+		for (auto & run : runs) {
+			if (run.position<run.buffer.size() && run.buffer[run.position].first==key) {
+				count += run.buffer[run.position++].second;
+				refill(run);
+			}
+		}
+		visit(key.first, key.second, count);
+	}
+	spill.records = 0;
+	spill.runs.clear();
+}
+
 int main(int argc, char ** argv) {
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
 	if (argc<2) {
-		fprintf(stderr, "usage: cdlp [path] [memory budget in GB]\n");
+		fprintf(stderr, "usage: cdlp [path] [memory budget in GB] [max iterations] [--stats=file] [--numa=1]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
 	long memory_bytes = (argc>=3)?atol(argv[2])*1024l*1024l*1024l:8l*1024l*1024l*1024l;
+	int max_iterations = (argc>=4)?atoi(argv[3]):10;
 
 	Graph graph(path);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
 	graph.set_memory_bytes(memory_bytes);
-	Bitmap * active_in = graph.alloc_bitmap();
-  Bitmap * active_out = graph.alloc_bitmap();
-  active_in->fill();
 	BigVector<VertexId> label(graph.path+"/label", graph.vertices);
-	graph.set_vertex_data_bytes( graph.vertices * sizeof(VertexId) );
-  VertexId active_vertices = graph.stream_vertices<VertexId>([&](VertexId i){
+	BigVector<VertexId> next_label(graph.path+"/next_label", graph.vertices);
+	graph.set_vertex_data_bytes( graph.vertices * sizeof(VertexId) * 2 );
+
+	graph.stream_vertices<VertexId>([&](VertexId i){
 		label[i] = i;
 		return 1;
 	});
 
+	// every column is owned by one thread (update_mode 2), so a target's histogram is built without atomics.
+	// raw pairs are compacted into the column's sorted histogram whenever a thread buffers too many of them,
+	// and when the sources come in several windows, each window's histogram is spilled and merged in the last.
+	// the memory is thus bounded by the distinct (target, label) pairs of one window of the columns in flight.
+	int parallelism = graph.get_parallelism();
+	size_t buffer_limit = std::max(1l<<16, memory_bytes / 4 / parallelism / (long)sizeof(LabelKey));
+	std::vector<LabelBuffer> buffers(parallelism);
+	std::vector<std::vector<LabelCount> > counts(graph.partitions);
+	std::vector<LabelSpill> spills(graph.partitions);
+	for (int column=0;column<graph.partitions;column++) {
+		std::string filename = graph.path + "/label_spill_" + std::to_string(column);
+		spills[column].fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		assert(spills[column].fd!=-1);
+		unlink(filename.c_str());
+		spills[column].records = 0;
+	}
+	bool last_window = false;
+
 	double start_time = get_time();
-  bool changed = false;
 	int iteration = 0;
-	while (iteration < 10) {
+	VertexId changed = graph.vertices;
+	while (changed!=0 && iteration<max_iterations) {
 		iteration++;
-    printf("Iteration: %d\n", iteration);
-		std::vector<LabelCounts*> label_counts(graph.vertices);
-    for (VertexId i = 0; i < graph.vertices; i++) {
-      label_counts[i] = new LabelCounts();
-    }
-    graph.hint(label);
-    graph.stream_edges<VertexId>([&](Edge & e){
-      label_counts[e.source]->add(label[e.target]);
-      return 1;
-    }, active_in);
-    // update label
-    changed = false;
-    for (VertexId i = 0; i < graph.vertices; i++) {
-      int max_count = 0;
-      int max_label = label[i];
-      for (auto it = label_counts[i]->counts.begin(); it != label_counts[i]->counts.end(); it++) {
-        if (it->second > max_count) {
-          max_count = it->second;
-          max_label = it->first;
-        }
-      }
-      if (max_label != label[i]) {
-        label[i] = max_label;
-        changed = true;
-      }
-    }
-    // delete label counts
-    for (VertexId i = 0; i < graph.vertices; i++) {
-      delete label_counts[i];
-    }
-    if (!changed) {
-      break;
-    }
+		graph.hint(label, next_label);
+		graph.stream_edges<VertexId>([&](UnweightedEdge & e){
+			LabelBuffer & buffer = buffers[worker_id()];
+			buffer.keys.push_back(std::make_pair((VertexId)e.target, label[e.source]));
+			if (buffer.keys.size()>=buffer_limit) {
+				merge_counts(buffer.keys, counts[buffer.column]);
+			}
+			return 0;
+		}, nullptr, 0, 2,
+		[&](std::pair<VertexId,VertexId> source_vid_range){
+			last_window = (source_vid_range.second==graph.vertices);
+		},
+		f_none_1,
+		[&](std::pair<VertexId,VertexId> target_vid_range){
+			if (target_vid_range.first==target_vid_range.second) return;
+			buffers[worker_id()].column = get_partition_id(graph.vertices, graph.partitions, target_vid_range.first);
+		},
+		[&](std::pair<VertexId,VertexId> target_vid_range){
+			if (target_vid_range.first==target_vid_range.second) return;
+			LabelBuffer & buffer = buffers[worker_id()];
+			std::vector<LabelCount> & column_counts = counts[buffer.column];
+			merge_counts(buffer.keys, column_counts);
+			if (!last_window) {
+				spill_counts(spills[buffer.column], column_counts);
+				return;
+			}
+			// the most frequent label wins, ties go to the smallest label; vertices without in-edges keep theirs
+			for (VertexId i=target_vid_range.first;i<target_vid_range.second;i++) {
+				next_label[i] = label[i];
+			}
+			VertexId target = 0, best_count = 0;
+			merge_spilled(spills[buffer.column], column_counts, [&](VertexId key_target, VertexId key_label, VertexId count){
+				if (best_count==0 || key_target!=target) {
+					target = key_target;
+					best_count = 0;
+				}
+				if (count>best_count) {
+					best_count = count;
+					next_label[target] = key_label;
+				}
+			});
+		});
+		changed = graph.stream_vertices<VertexId>([&](VertexId i){
+			VertexId changed = (label[i]!=next_label[i]);
+			label[i] = next_label[i];
+			return changed;
+		});
+		printf("%7d: %ld labels changed\n", iteration, (long)changed);
+	}
+	for (auto & spill : spills) {
+		close(spill.fd);
 	}
 	double end_time = get_time();
 
@@ -94,7 +232,10 @@ int main(int argc, char ** argv) {
 		write_add(&label_stat[label[i]], 1);
 		return 1;
 	});
-  printf("Total time: %.2f seconds\n", end_time - start_time);
+	VertexId communities = graph.stream_vertices<VertexId>([&](VertexId i){
+		return label_stat[i]!=0;
+	});
+	printf("%ld communities found after %d iterations in %.2f seconds\n", (long)communities, iteration, end_time - start_time);
 
 	return 0;
 }
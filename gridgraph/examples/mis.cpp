@@ -17,14 +17,18 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include "core/graph.hpp"
 
 int main(int argc, char ** argv) {
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
 	if (argc<2) {
-		fprintf(stderr, "usage: mis [path] [memory budget in GB]\n");
+		fprintf(stderr, "usage: mis [path] [memory budget in GB] [--stats=file] [--numa=1]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
 	long memory_bytes = ((argc>=3)?atol(argv[2]):8l) * (1024l*1024l*1024l);
 
 	Graph graph(path);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
 	graph.set_memory_bytes(memory_bytes);
 	Bitmap * active_in = graph.alloc_bitmap();
 	Bitmap * active_out = graph.alloc_bitmap();
@@ -41,9 +45,9 @@ int main(int argc, char ** argv) {
 	int iteration = 0;
 	while (true) {
 		iteration++;
-		printf("%7d: %d\n", iteration, active_vertices);
+		printf("%7d: %ld\n", iteration, (long)active_vertices);
 		std::swap(active_in, active_out);
-		graph.stream_edges<VertexId>([&](Edge & e) {
+		graph.stream_edges<VertexId>([&](UnweightedEdge & e) {
 			if (e.source<e.target && in_mis[e.target]) {
 				in_mis[e.target] = false;
 			}
@@ -63,7 +67,7 @@ int main(int argc, char ** argv) {
 		active_vertices = next_active_vertices;
 	}
 	double end_time = get_time();
-	printf("in_mis: %d\n", active_vertices);
+	printf("in_mis: %ld\n", (long)active_vertices);
 	printf("time: %.2f seconds\n", end_time - start_time);
 
 	return 0;
@@ -15,10 +15,14 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 */
 
 #include "core/graph.hpp"
+#include "core/checkpoint.hpp"
 
 int main(int argc, char ** argv) {
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
+	int checkpoint_interval = atoi(take_flag(argc, argv, "--checkpoint=").c_str());
 	if (argc<3) {
-		fprintf(stderr, "usage: pagerank [path] [iterations] [memory budget in GB]\n");
+		fprintf(stderr, "usage: pagerank [path] [iterations] [memory budget in GB] [--stats=file] [--numa=1] [--checkpoint=iterations]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
@@ -26,19 +30,35 @@ int main(int argc, char ** argv) {
 	long memory_bytes = (argc>=4)?atol(argv[3])*1024l*1024l*1024l:8l*1024l*1024l*1024l;
 
 	Graph graph(path);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
 	graph.set_memory_bytes(memory_bytes);
 	BigVector<VertexId> degree(graph.path+"/degree", graph.vertices);
 	BigVector<float> pagerank(graph.path+"/pagerank", graph.vertices);
-	BigVector<float> sum(graph.path+"/sum", graph.vertices);
 
 	long vertex_data_bytes = (long)graph.vertices * ( sizeof(VertexId) + sizeof(float) + sizeof(float) );
 	graph.set_vertex_data_bytes(vertex_data_bytes);
 
+	// sum is scratch: when the vertex data fits in memory it needs no file, and huge pages cut the TLB misses of its random updates
+	BigVector<float> sum;
+	if (vertex_data_bytes <= memory_bytes) {
+		sum.init(graph.vertices, MEMORY_HUGE_PAGES);
+		sum.place(graph.partitions);
+	} else {
+		sum.init(graph.path+"/sum", graph.vertices);
+	}
+
+	// when the grid does not fit next to the vertex data, keep what fits of it in memory across iterations
+	bool cached = graph.edge_bytes() > memory_bytes - vertex_data_bytes;
+	if (cached) {
+		graph.set_edge_cache(std::max(memory_bytes - vertex_data_bytes, 0l) / 2);
+	}
+
 	double begin_time = get_time();
 
 	degree.fill(0);
 	graph.stream_edges<VertexId>(
-		[&](Edge & e){
+		[&](UnweightedEdge & e){
 			write_add(&degree[e.source], 1);
 			return 0;
 		}, nullptr, 0, 0
@@ -63,20 +83,54 @@ int main(int argc, char ** argv) {
 		}
 	);
 
-	for (int iter=0;iter<iterations;iter++) {
+	// with at least one column per thread every target is owned by a single thread and needs no atomics;
+	// otherwise threads share columns and accumulate into private partial sums
+	bool owned = graph.partitions >= graph.get_parallelism();
+	Accumulator<float> accumulator(sum, graph.get_parallelism(), owned ? 0 : memory_bytes / 4);
+
+	// between iterations sum is all zeros and pagerank holds the scaled ranks, so pagerank is the whole state
+	Checkpoint checkpoint(graph.path+"/checkpoint_pagerank", checkpoint_interval);
+	checkpoint.add("pagerank", pagerank);
+	int first_iter = 0;
+	if (checkpoint_interval>0) {
+		first_iter = checkpoint.resume();
+		if (first_iter>=iterations) {
+			fprintf(stderr, "the checkpoint is at iteration %d, beyond the %d requested\n", first_iter, iterations);
+			exit(-1);
+		}
+		if (first_iter>0) printf("resumed after iteration %d\n", first_iter);
+	}
+
+	for (int iter=first_iter;iter<iterations;iter++) {
 		graph.hint(pagerank);
-		graph.stream_edges<VertexId>(
-			[&](Edge & e){
-				write_add(&sum[e.target], pagerank[e.source]);
-				return 0;
-			}, nullptr, 0, 1,
-			[&](std::pair<VertexId,VertexId> source_vid_range){
-				pagerank.lock(source_vid_range.first, source_vid_range.second);
-			},
-			[&](std::pair<VertexId,VertexId> source_vid_range){
-				pagerank.unlock(source_vid_range.first, source_vid_range.second);
-			}
-		);
+		if (owned) {
+			graph.stream_edges<VertexId>(
+				[&](UnweightedEdge & e){
+					sum[e.target] += pagerank[e.source];
+					return 0;
+				}, nullptr, 0, 2,
+				[&](std::pair<VertexId,VertexId> source_vid_range){
+					pagerank.lock(source_vid_range.first, source_vid_range.second);
+				},
+				[&](std::pair<VertexId,VertexId> source_vid_range){
+					pagerank.unlock(source_vid_range.first, source_vid_range.second);
+				}
+			);
+		} else {
+			graph.stream_edges<VertexId>(
+				[&](UnweightedEdge & e){
+					accumulator.add(e.target, pagerank[e.source]);
+					return 0;
+				}, nullptr, 0, 1,
+				[&](std::pair<VertexId,VertexId> source_vid_range){
+					pagerank.lock(source_vid_range.first, source_vid_range.second);
+				},
+				[&](std::pair<VertexId,VertexId> source_vid_range){
+					pagerank.unlock(source_vid_range.first, source_vid_range.second);
+				}
+			);
+			accumulator.flush();
+		}
 		graph.hint(pagerank, sum);
 		if (iter==iterations-1) {
 			graph.stream_vertices<VertexId>(
@@ -107,10 +161,16 @@ int main(int argc, char ** argv) {
 					sum.save();
 				}
 			);
+			checkpoint.save(iter+1);
 		}
 	}
+	checkpoint.clear();
 
 	double end_time = get_time();
 	printf("%d iterations of pagerank took %.2f seconds\n", iterations, end_time - begin_time);
+	if (cached) {
+		printf("last iteration: %ld bytes of edges from the cache (%ld unpinned), %ld bytes read\n", graph.cache_hit_bytes(), graph.cache_unpinned_bytes(), graph.cache_miss_bytes());
+	}
+	printf("thread startup overhead: %.3f ms per call over %ld calls\n", graph.stream_startup_time() * 1e3, graph.stream_calls());
 
 }
@@ -14,141 +14,74 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
    limitations under the License.
 */
 
-#include "core/graph.hpp"
+#include "core/msbfs.hpp"
+#include "core/checkpoint.hpp"
 
 #define K 64
 
 int main(int argc, char ** argv) {
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
+	bool checkpointed = atoi(take_flag(argc, argv, "--checkpoint=").c_str())>0;
 	if (argc<2) {
-		fprintf(stderr, "usage: mis [path] [memory budget in GB]\n");
+		fprintf(stderr, "usage: radii [path] [memory budget in GB] [--stats=file] [--numa=1] [--checkpoint=1]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
 	long memory_bytes = ((argc>=3)?atol(argv[2]):8l) * (1024l*1024l*1024l);
 
 	Graph graph(path);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
 	graph.set_memory_bytes(memory_bytes);
-	Bitmap * active_in = graph.alloc_bitmap();
-	Bitmap * active_out = graph.alloc_bitmap();
-	BigVector<unsigned long [2]> visited(graph.path+"/visited", graph.vertices);
+	MultiSourceBFS<K> bfs(graph);
 	BigVector<VertexId> radii(graph.path+"/radii", graph.vertices);
-	graph.set_vertex_data_bytes( graph.vertices * ( sizeof(VertexId) + sizeof(long) * 2 ) );
+	graph.set_vertex_data_bytes( graph.vertices * ( sizeof(VertexId) + sizeof(SourceSet<K>) * 3 ) );
 
 	srand(time(NULL));
 
 	double start_time = get_time();
-	int iteration;
-	VertexId active_vertices;
-	VertexId max_radii;
+	// radii[v]: the level at which the last of the sources reached v, the eccentricity estimate of v
+	auto estimate = [&](const std::vector<VertexId> & sources){
+		radii.fill(-1);
+		int levels = bfs.run(sources, [&](VertexId v, int level, const SourceSet<K> & reached){
+			radii[v] = level;
+		});
+		printf("%7lu sources: %d levels\n", sources.size(), levels);
+		return (VertexId)levels;
+	};
 
-	active_out->clear();
-	graph.stream_vertices<VertexId>([&](VertexId i){
-		visited[i][0] = 0ul;
-		visited[i][1] = 0ul;
-		radii[i] = -1;
-		return 0;
-	});
-	for (int k=0;k<K;k++) {
-		VertexId vid = rand() % graph.vertices;
-		visited[vid][1] |= (1ul << k);
-		radii[vid] = 0;
-		active_out->set_bit(vid);
-	}
-	iteration = 0;
-	active_vertices = K;
-	while (active_vertices > 0) {
-		iteration++;
-		printf("%7d: %d\n", iteration, active_vertices);
-		int now = iteration % 2;
-		int next = 1 - now;
-		std::swap(active_in, active_out);
-		active_out->clear();
-		active_vertices = graph.stream_edges<VertexId>([&](Edge & e) {
-			if (visited[e.target][now] != visited[e.source][now]) {
-				__sync_fetch_and_or( &visited[e.target][next], visited[e.source][now] );
-				VertexId old_radii = radii[e.target];
-				if (radii[e.target]!=iteration) {
-					if (cas(&radii[e.target], old_radii, iteration)) {
-						active_out->set_bit(e.target);
-						return 1;
-					}
-				}
-			}
-			return 0;
-		}, active_in);
-		active_vertices = graph.stream_vertices<VertexId>([&](VertexId i){
-			visited[i][now] = visited[i][next];
-			return 1;
-		}, active_out); // necessary?
-	}
-	max_radii = 0;
-	for (VertexId i=0;i<graph.vertices;i++) {
-		if (max_radii < radii[i]) {
-			max_radii = radii[i];
+	// first from random sources, then again from the vertices farthest from them. the second pass only
+	// needs the estimates of the first, which are checkpointed in between
+	VertexId max_radii = 0;
+	Checkpoint checkpoint(graph.path+"/checkpoint_radii", checkpointed ? 1 : 0);
+	checkpoint.add("radii", radii);
+	checkpoint.add("max_radii", max_radii);
+	if (checkpointed && checkpoint.resume()>0) {
+		printf("resumed after the first pass\n");
+	} else {
+		std::vector<VertexId> sources;
+		for (int k=0;k<K;k++) {
+			sources.push_back(rand() % graph.vertices);
 		}
+		max_radii = estimate(sources);
+		checkpoint.save(1);
 	}
 	std::vector<VertexId> candidates;
 	VertexId threshold = 0;
-	while (candidates.size()<K) {
-		for (VertexId i=0;i<graph.vertices;i++) {
+	while (candidates.size()<K && threshold<=max_radii) {
+		for (VertexId i=0;i<graph.vertices && candidates.size()<K;i++) {
 			if (radii[i]==max_radii-threshold) candidates.push_back(i);
 		}
 		threshold++;
 	}
-	printf("radii:%d\n", max_radii);
-
-	active_out->clear();
-	graph.stream_vertices<VertexId>([&](VertexId i){
-		visited[i][0] = 0ul;
-		visited[i][1] = 0ul;
-		radii[i] = -1;
-		return 0;
-	});
-	for (int k=0;k<K;k++) {
-		VertexId vid = candidates[k];
-		visited[vid][1] |= (1ul << k);
-		radii[vid] = 0;
-		active_out->set_bit(vid);
-	}
-	iteration = 0;
-	active_vertices = K;
-	while (active_vertices > 0) {
-		iteration++;
-		printf("%7d: %d\n", iteration, active_vertices);
-		int now = iteration % 2;
-		int next = 1 - now;
-		std::swap(active_in, active_out);
-		active_out->clear();
-		active_vertices = graph.stream_edges<VertexId>([&](Edge & e) {
-			if (visited[e.target][now] != visited[e.source][now]) {
-				__sync_fetch_and_or( &visited[e.target][next], visited[e.source][now] );
-				VertexId old_radii = radii[e.target];
-				if (radii[e.target]!=iteration) {
-					if (cas(&radii[e.target], old_radii, iteration)) {
-						active_out->set_bit(e.target);
-						return 1;
-					}
-				}
-			}
-			return 0;
-		}, active_in);
-		active_vertices = graph.stream_vertices<VertexId>([&](VertexId i){
-			visited[i][now] = visited[i][next];
-			return 1;
-		}, active_out); // necessary?
-	}
-	max_radii = 0;
-	for (VertexId i=0;i<graph.vertices;i++) {
-		if (max_radii < radii[i]) {
-			max_radii = radii[i];
-		}
-	}
-	printf("radii: %d\n", max_radii);
+	printf("radii: %ld\n", (long)max_radii);
+	max_radii = std::max(max_radii, estimate(candidates));
+	checkpoint.clear();
 
 	double end_time = get_time();
-	printf("radii: %d\n", max_radii);
+	printf("radii: %ld\n", (long)max_radii);
 	printf("time: %.2f seconds\n", end_time - start_time);
 
 	return 0;
 }
-
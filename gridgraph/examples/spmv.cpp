@@ -17,15 +17,19 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include "core/graph.hpp"
 
 int main(int argc, char ** argv) {
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
 	if (argc<2) {
-		fprintf(stderr, "usage: spmv [path] [memory budget in GB]\n");
+		fprintf(stderr, "usage: spmv [path] [memory budget in GB] [--stats=file] [--numa=1]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
 	long memory_bytes = ((argc>=4)?atol(argv[3]):8l)*1024l*1024l*1024l;
 
 	Graph graph(path);
-	assert(graph.edge_type==1);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
+	assert(is_weighted(graph.edge_type));
 	graph.set_memory_bytes(memory_bytes);
 	BigVector<float> input(graph.path+"/input", graph.vertices);
 	BigVector<float> output(graph.path+"/output", graph.vertices);
@@ -49,11 +53,17 @@ int main(int argc, char ** argv) {
 		}
 	);
 	graph.hint(input);
+	bool owned = graph.partitions >= graph.get_parallelism();
+	Accumulator<float> accumulator(output, graph.get_parallelism(), owned ? 0 : memory_bytes / 4);
 	graph.stream_edges<float>(
 		[&](Edge & e){
-			write_add(&output[e.target], input[e.source] * e.weight);
+			if (owned) {
+				output[e.target] += input[e.source] * e.weight;
+			} else {
+				accumulator.add(e.target, input[e.source] * e.weight);
+			}
 			return 0;
-		}, nullptr, 0, 1,
+		}, nullptr, 0, owned ? 2 : 1,
 		[&](std::pair<VertexId,VertexId> source_vid_range){
 			input.lock(source_vid_range.first, source_vid_range.second);
 		},
@@ -61,6 +71,7 @@ int main(int argc, char ** argv) {
 			input.unlock(source_vid_range.first, source_vid_range.second);
 		}
 	);
+	accumulator.flush();
 	double end_time = get_time();
 
 	printf("spmv took %.2f seconds\n", end_time - begin_time);
@@ -14,59 +14,135 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
    limitations under the License.
 */
 
+#include <limits>
+
 #include "core/graph.hpp"
 
+const float INF = std::numeric_limits<float>::infinity();
+
+// delta-stepping: pending vertices (distance lowered, out-edges not relaxed yet) are bucketed by distance / delta.
+// each round relaxes the out-edges of the pending vertices in the lowest non-empty bucket; improved vertices
+// become pending again, and the bucket is settled once none of them falls back into it.
+// delta = infinity is Bellman-Ford: every round relaxes all pending vertices.
+// returns the number of rounds (edge passes).
+int shortest_paths(Graph & graph, BigVector<float> & distance, VertexId start_vid, float delta) {
+	bool weighted = is_weighted(graph.edge_type);
+	Frontier * active = graph.alloc_frontier();
+	Frontier * pending = graph.alloc_frontier();
+	Frontier * next_pending = graph.alloc_frontier();
+
+	distance.fill(INF);
+	distance[start_vid] = 0;
+	pending->add(start_vid);
+
+	int rounds = 0;
+	float bound = delta;
+	while (pending->size()!=0) {
+		active->clear();
+		next_pending->clear();
+		float lowest = INF;
+		graph.stream_vertices<VertexId>([&](VertexId i){
+			if (distance[i] < bound) {
+				active->add(i);
+			} else {
+				next_pending->add(i);
+				write_min(&lowest, distance[i]);
+			}
+			return 0;
+		}, *pending);
+		std::swap(pending, next_pending);
+		if (active->size()==0) {
+			// move on to the bucket of the closest pending vertex
+			bound = (floor(lowest / delta) + 1) * delta;
+			continue;
+		}
+		rounds++;
+		graph.hint(distance);
+		graph.traverse<VertexId>([&](Edge & e){
+			float relaxed = distance[e.source] + (weighted ? e.weight : 1.f);
+			if (relaxed < distance[e.target]) {
+				if (write_min(&distance[e.target], relaxed)) {
+					pending->add(e.target);
+					return 1;
+				}
+			}
+			return 0;
+		}, *active);
+	}
+
+	delete active;
+	delete pending;
+	delete next_pending;
+	return rounds;
+}
+
+// a round costs a pass over the active blocks however few vertices it relaxes, so buckets are made wide:
+// mean edge weight times mean out-degree. narrower buckets save relaxations but add rounds.
+float choose_delta(Graph & graph) {
+	double mean_degree = std::max((double)graph.edges / graph.vertices, 1.0);
+	if (!is_weighted(graph.edge_type)) {
+		return mean_degree;
+	}
+	double total_weight = graph.stream_edges<double>([&](Edge & e){
+		return (double)e.weight;
+	}, nullptr, 0, 0);
+	return std::max(total_weight / graph.edges, 1e-6) * mean_degree;
+}
+
 int main(int argc, char ** argv) {
-	if (argc<4) {
-		fprintf(stderr, "usage: bfs [path] [start vertex id] [end vertex id] [memory budget in GB]\n");
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
+	if (argc<3) {
+		fprintf(stderr, "usage: sssp [path] [start vertex id] [memory budget in GB] [delta: 0 = auto, -1 = Bellman-Ford] [check against Bellman-Ford: 0/1] [--stats=file] [--numa=1]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
-	VertexId start_vid = atoi(argv[2]);
-  VertexId end_vid = atoi(argv[3]);
-	long memory_bytes = (argc>=5)?atol(argv[5])*1024l*1024l*1024l:8l*1024l*1024l*1024l;
+	VertexId start_vid = atol(argv[2]);
+	long memory_bytes = (argc>=4)?atol(argv[3])*1024l*1024l*1024l:8l*1024l*1024l*1024l;
+	float delta = (argc>=5)?atof(argv[4]):0;
+	bool check = (argc>=6) && atoi(argv[5])!=0;
 
 	Graph graph(path);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
 	graph.set_memory_bytes(memory_bytes);
-	Bitmap * active_in = graph.alloc_bitmap();
-	Bitmap * active_out = graph.alloc_bitmap();
-	BigVector<VertexId> parent(graph.path+"/parent", graph.vertices);
-	graph.set_vertex_data_bytes( graph.vertices * sizeof(VertexId) );
-
-	active_out->clear();
-	active_out->set_bit(start_vid);
-	parent.fill(-1);
-	parent[start_vid] = start_vid;
-	VertexId active_vertices = 1;
+	if (!is_weighted(graph.edge_type)) {
+		printf("unweighted grid: every edge has weight 1\n");
+	}
+	BigVector<float> distance(graph.path+"/distance", graph.vertices);
+	graph.set_vertex_data_bytes( graph.vertices * sizeof(float) );
 
 	double start_time = get_time();
-	int iteration = 0;
-  bool found = false;
-	while (active_vertices!=0 && !found) {
-		iteration++;
-		printf("%7d: %d\n", iteration, active_vertices);
-		std::swap(active_in, active_out);
-		active_out->clear();
-		graph.hint(parent);
-		active_vertices = graph.stream_edges<VertexId>([&](Edge & e){
-			if (parent[e.target]==-1) {
-				if (cas(&parent[e.target], -1, e.source)) {
-					active_out->set_bit(e.target);
-					return 1;
-				}
-			}
-      if (e.target == end_vid) {
-        found = true;
-      }
-			return 0;
-		}, active_in);
+	if (delta==0) {
+		delta = choose_delta(graph);
+	} else if (delta<0) {
+		delta = INF;
 	}
+	int rounds = shortest_paths(graph, distance, start_vid, delta);
 	double end_time = get_time();
 
-	int discovered_vertices = graph.stream_vertices<VertexId>([&](VertexId i){
-		return parent[i]!=-1;
+	VertexId reached_vertices = graph.stream_vertices<VertexId>([&](VertexId i){
+		return distance[i]!=INF;
 	});
-	printf("discovered %d vertices from %d in %.2f seconds.\n", discovered_vertices, start_vid, end_time - start_time);
+	if (delta==INF) {
+		printf("reached %ld vertices from %ld in %.2f seconds (Bellman-Ford, %d rounds)\n", (long)reached_vertices, (long)start_vid, end_time - start_time, rounds);
+	} else {
+		printf("reached %ld vertices from %ld in %.2f seconds (delta %g, %d rounds)\n", (long)reached_vertices, (long)start_vid, end_time - start_time, delta, rounds);
+	}
+	printf("streamed %ld bytes of edges, skipped %ld bytes of inactive blocks\n", graph.streamed_bytes(), graph.skipped_bytes());
+
+	if (check) {
+		BigVector<float> reference(graph.path+"/distance_check", graph.vertices);
+		start_time = get_time();
+		rounds = shortest_paths(graph, reference, start_vid, INF);
+		end_time = get_time();
+		printf("Bellman-Ford took %.2f seconds (%d rounds)\n", end_time - start_time, rounds);
+		VertexId mismatches = graph.stream_vertices<VertexId>([&](VertexId i){
+			if (distance[i]==reference[i]) return 0;
+			return fabs(distance[i] - reference[i]) > 1e-5 * fabs(reference[i]) ? 1 : 0;
+		});
+		printf("%ld distances differ from Bellman-Ford\n", (long)mismatches);
+	}
 
 	return 0;
 }
@@ -15,19 +15,25 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 */
 
 #include "core/graph.hpp"
+#include "core/checkpoint.hpp"
 
 int main(int argc, char ** argv) {
+	std::string stats = take_flag(argc, argv, "--stats=");
+	bool numa_affine = take_flag(argc, argv, "--numa=")=="1";
+	int checkpoint_interval = atoi(take_flag(argc, argv, "--checkpoint=").c_str());
 	if (argc<2) {
-		fprintf(stderr, "usage: wcc [path] [memory budget in GB]\n");
+		fprintf(stderr, "usage: wcc [path] [memory budget in GB] [--stats=file] [--numa=1] [--checkpoint=iterations]\n");
 		exit(-1);
 	}
 	std::string path = argv[1];
 	long memory_bytes = (argc>=3)?atol(argv[2])*1024l*1024l*1024l:8l*1024l*1024l*1024l;
 
 	Graph graph(path);
+	graph.set_stats(stats);
+	graph.set_numa_affinity(numa_affine);
 	graph.set_memory_bytes(memory_bytes);
-	Bitmap * active_in = graph.alloc_bitmap();
-	Bitmap * active_out = graph.alloc_bitmap();
+	Frontier * active_in = graph.alloc_frontier();
+	Frontier * active_out = graph.alloc_frontier();
 	BigVector<VertexId> label(graph.path+"/label", graph.vertices);
 	graph.set_vertex_data_bytes( graph.vertices * sizeof(VertexId) );
 
@@ -37,24 +43,36 @@ int main(int argc, char ** argv) {
 		return 1;
 	});
 
-	double start_time = get_time();
+	Checkpoint checkpoint(graph.path+"/checkpoint_wcc", checkpoint_interval);
+	checkpoint.add("label", label);
+	checkpoint.add("active", active_out);
+	checkpoint.add("active_vertices", active_vertices);
 	int iteration = 0;
+	if (checkpoint_interval>0) {
+		iteration = checkpoint.resume();
+		if (iteration>0) printf("resumed after iteration %d\n", iteration);
+	}
+
+	double start_time = get_time();
 	while (active_vertices!=0) {
 		iteration++;
-		printf("%7d: %d\n", iteration, active_vertices);
 		std::swap(active_in, active_out);
 		active_out->clear();
 		graph.hint(label);
-		active_vertices = graph.stream_edges<VertexId>([&](Edge & e){
+		VertexId frontier = active_vertices;
+		active_vertices = graph.traverse<VertexId>([&](UnweightedEdge & e){
 			if (label[e.source]<label[e.target]) {
 				if (write_min(&label[e.target], label[e.source])) {
-					active_out->set_bit(e.target);
+					active_out->add(e.target);
 					return 1;
 				}
 			}
 			return 0;
-		}, active_in);
+		}, *active_in);
+		printf("%7d: %ld (%s)\n", iteration, (long)frontier, graph.last_direction()==PUSH?"push":"pull");
+		checkpoint.save(iteration);
 	}
+	checkpoint.clear();
 	double end_time = get_time();
 
 	BigVector<VertexId> label_stat(graph.path+"/label_stat", graph.vertices);
@@ -66,7 +84,9 @@ int main(int argc, char ** argv) {
 	VertexId components = graph.stream_vertices<VertexId>([&](VertexId i){
 		return label_stat[i]!=0;
 	});
-	printf("%d components found in %.2f seconds\n", components, end_time - start_time);
+	printf("%ld components found in %.2f seconds\n", (long)components, end_time - start_time);
+	printf("streamed %ld bytes of edges, skipped %ld bytes of inactive blocks\n", graph.streamed_bytes(), graph.skipped_bytes());
+	printf("thread startup overhead: %.3f ms per call over %ld calls\n", graph.stream_startup_time() * 1e3, graph.stream_calls());
 
 	return 0;
 }
@@ -1,25 +1,28 @@
 #!/bin/bash
 
+# every run also appends one JSON line per edge pass to data/[graph]_[algorithm].stats
+rm -f data/*.stats
+
 ./bin/preprocess -i ../../graph-baselines/runtime/data/wikitalk.json3 -o ./data/wikitalk_grid -v 2394385 -p 4 -t 0
 echo "bfs on wikitalk_grid..."
-./bin/bfs data/wikitalk_grid 6765 | grep seconds
+./bin/bfs data/wikitalk_grid 6765 --stats=data/wikitalk_bfs.stats | grep seconds
 echo "pagerank on wikitalk_grid..."
-./bin/pagerank data/wikitalk_grid 10 | grep seconds
+./bin/pagerank data/wikitalk_grid 10 --stats=data/wikitalk_pagerank.stats | grep seconds
 echo "wcc on wikitalk_grid..."
-./bin/wcc data/wikitalk_grid | grep seconds
+./bin/wcc data/wikitalk_grid --stats=data/wikitalk_wcc.stats | grep seconds
 echo "sssp on wikitalk_grid..."
-./bin/sssp data/wikitalk_grid 32822 33 | grep seconds
+./bin/sssp data/wikitalk_grid 32822 --stats=data/wikitalk_sssp.stats | grep seconds
 echo "cdlp on wikitalk_grid..."
-./bin/cdlp data/wikitalk_grid
+./bin/cdlp data/wikitalk_grid --stats=data/wikitalk_cdlp.stats | grep seconds
 
 ./bin/preprocess -i ../../graph-baselines/runtime/data/cit-patents.json3 -o ./data/citpatents_grid -v 3774769 -p 4 -t 0
 echo "bfs on citpatents_grid..."
-./bin/bfs data/citpatents_grid 3494505 | grep seconds
+./bin/bfs data/citpatents_grid 3494505 --stats=data/citpatents_bfs.stats | grep seconds
 echo "pagerank on citpatents_grid..."
-./bin/pagerank data/citpatents_grid 10 | grep seconds
+./bin/pagerank data/citpatents_grid 10 --stats=data/citpatents_pagerank.stats | grep seconds
 echo "wcc on citpatents_grid..."
-./bin/wcc data/citpatents_grid | grep seconds
+./bin/wcc data/citpatents_grid --stats=data/citpatents_wcc.stats | grep seconds
 echo "sssp on citpatents_grid..."
-./bin/sssp data/citpatents_grid 3494505 754148 | grep seconds
+./bin/sssp data/citpatents_grid 3494505 --stats=data/citpatents_sssp.stats | grep seconds
 echo "cdlp on citpatents_grid..."
-./bin/cdlp data/citpatents_grid
\ No newline at end of file
+./bin/cdlp data/citpatents_grid --stats=data/citpatents_cdlp.stats | grep seconds
\ No newline at end of file
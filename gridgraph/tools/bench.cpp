@@ -0,0 +1,286 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// measures the core primitives in isolation on synthetic grids, printing one JSON line per measurement
+
+#include "core/graph.hpp"
+
+#include <random>
+#include <sstream>
+
+std::vector<long> parse_list(const char * text) {
+	std::vector<long> values;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		values.push_back(atol(item.c_str()));
+	}
+	return values;
+}
+
+// an unweighted grid of 2^scale vertices and edge_factor * 2^scale edges, either uniform or RMAT
+// (a = 0.57, b = c = 0.19); a grid already at path is reused, since the generator is deterministic and path
+// names every parameter
+void write_grid(std::string path, std::string generator, int scale, int edge_factor, int partitions) {
+	if (file_exists(path+"/meta")) return;
+	if (file_exists(path)) {
+		remove_directory(path);
+	}
+	create_directory(path);
+	VertexId vertices = 1l << scale;
+	EdgeId edges = (EdgeId)edge_factor << scale;
+	std::vector<std::vector<UnweightedEdge> > blocks(partitions * partitions);
+	std::mt19937_64 rng(scale);
+	std::uniform_real_distribution<double> uniform(0, 1);
+	for (EdgeId e=0;e<edges;e++) {
+		UnweightedEdge edge;
+		if (generator=="rmat") {
+			VertexId source = 0, target = 0;
+			for (int bit=0;bit<scale;bit++) {
+				double r = uniform(rng);
+				source = source * 2 + (r >= 0.57 + 0.19);
+				target = target * 2 + ((r >= 0.57 && r < 0.57 + 0.19) || r >= 0.57 + 0.19 + 0.19);
+			}
+			edge.source = source;
+			edge.target = target;
+		} else {
+			edge.source = rng() % vertices;
+			edge.target = rng() % vertices;
+		}
+		int i = get_partition_id(vertices, partitions, edge.source);
+		int j = get_partition_id(vertices, partitions, edge.target);
+		blocks[i*partitions+j].push_back(edge);
+	}
+	for (int layout=0;layout<2;layout++) {
+		FILE * fout = fopen((path+(layout==0?"/column":"/row")).c_str(), "wb");
+		FILE * fout_offset = fopen((path+(layout==0?"/column_offset":"/row_offset")).c_str(), "wb");
+		long offset = 0;
+		for (int a=0;a<partitions;a++) {
+			for (int b=0;b<partitions;b++) {
+				fwrite(&offset, sizeof(offset), 1, fout_offset);
+				std::vector<UnweightedEdge> & block = (layout==0) ? blocks[b*partitions+a] : blocks[a*partitions+b];
+				fwrite(block.data(), sizeof(UnweightedEdge), block.size(), fout);
+				offset += block.size() * sizeof(UnweightedEdge);
+			}
+		}
+		fwrite(&offset, sizeof(offset), 1, fout_offset);
+		fclose(fout_offset);
+		fclose(fout);
+	}
+	FILE * fmeta = fopen((path+"/meta").c_str(), "w");
+	fprintf(fmeta, "%d %ld %ld %d %d", 0, (long)vertices, edges, partitions, (int)sizeof(VertexId));
+	fclose(fmeta);
+}
+
+// the setting of a measurement; -1 marks what does not apply
+struct Setting {
+	std::string graph;
+	int scale;
+	int edge_factor;
+	int partitions;
+	int threads;
+	long budget_mb; // 0: unlimited
+};
+
+int repeats = 5;
+
+// one warm-up run, then repeats timed samples; items is what one run processes. runs shorter than 10 ms
+// are repeated within a sample so that the timer resolution does not matter
+template <typename F>
+void measure(const char * primitive, const char * variant, const Setting & setting, double items, F run) {
+	int runs = 1;
+	double start_time = get_time();
+	run();
+	double elapsed = get_time() - start_time;
+	if (elapsed < 0.01) {
+		runs = std::min(1000000.0, 0.01 / std::max(elapsed, 1e-7));
+	}
+	std::vector<double> seconds;
+	for (int r=0;r<repeats;r++) {
+		start_time = get_time();
+		for (int k=0;k<runs;k++) {
+			run();
+		}
+		seconds.push_back((get_time() - start_time) / runs);
+	}
+	std::sort(seconds.begin(), seconds.end());
+	double median = seconds[seconds.size() / 2];
+	printf("{\"primitive\":\"%s\",\"variant\":\"%s\",\"graph\":\"%s\",\"scale\":%d,\"edge_factor\":%d,\"partitions\":%d,\"threads\":%d,\"budget_mb\":%ld,\"repeats\":%d,\"best_seconds\":%.6f,\"median_seconds\":%.6f,\"items_per_second\":%.1f}\n",
+		primitive, variant, setting.graph.c_str(), setting.scale, setting.edge_factor, setting.partitions, setting.threads, setting.budget_mb, repeats, seconds[0], median, items / median);
+	fflush(stdout);
+}
+
+// one producer hands items to threads consumers, as stream_edges hands out chunks
+void bench_queue(int queue_type, int threads, long items) {
+	TaskQueue<std::tuple<int, long, long> > queue(65536, queue_type);
+	std::vector<std::thread> consumers;
+	for (int t=0;t<threads;t++) {
+		consumers.emplace_back([&](){
+			while (std::get<0>(queue.pop())!=-1);
+		});
+	}
+	for (long k=0;k<items;k++) {
+		queue.push(std::make_tuple(0, k, 0l));
+	}
+	for (int t=0;t<threads;t++) {
+		queue.push(std::make_tuple(-1, 0l, 0l));
+	}
+	for (int t=0;t<threads;t++) {
+		consumers[t].join();
+	}
+}
+
+int main(int argc, char ** argv) {
+	int opt;
+	std::string path = "";
+	std::vector<long> scales = {16, 18};
+	int edge_factor = 16;
+	std::vector<long> partition_counts = {4, 16};
+	std::vector<long> thread_counts;
+	std::vector<long> budgets = {0, 16};
+	for (int t=1;t<(int)std::thread::hardware_concurrency();t*=2) {
+		thread_counts.push_back(t);
+	}
+	thread_counts.push_back(std::thread::hardware_concurrency());
+	while ((opt = getopt(argc, argv, "o:s:e:p:t:m:r:")) != -1) {
+		switch (opt) {
+		case 'o':
+			path = optarg;
+			break;
+		case 's':
+			scales = parse_list(optarg);
+			break;
+		case 'e':
+			edge_factor = atoi(optarg);
+			break;
+		case 'p':
+			partition_counts = parse_list(optarg);
+			break;
+		case 't':
+			thread_counts = parse_list(optarg);
+			break;
+		case 'm':
+			budgets = parse_list(optarg);
+			break;
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		}
+	}
+	if (path=="" || repeats<1) {
+		fprintf(stderr, "usage: %s -o [scratch path] -s [scales (log2 vertices): 16,18] -e [edge factor: 16] -p [partitions: 4,16] -t [threads: 1,2,4..cores] -m [memory budgets in MB, 0 = unlimited: 0,16] -r [repeats: 5]\n", argv[0]);
+		exit(-1);
+	}
+	create_directory(path);
+	const long unlimited = 1024l*1024l*1024l*1024l;
+
+	const long queue_items = 1l << 20;
+	for (long threads : thread_counts) {
+		Setting setting = {"none", -1, -1, -1, (int)threads, 0};
+		measure("queue", "lock-free", setting, queue_items, [&](){ bench_queue(QUEUE_LOCKFREE, threads, queue_items); });
+		measure("queue", "mutex", setting, queue_items, [&](){ bench_queue(QUEUE_MUTEX, threads, queue_items); });
+	}
+
+	for (long scale : scales) {
+		VertexId vertices = 1l << scale;
+		Setting setting = {"none", (int)scale, -1, -1, 1, 0};
+		Bitmap bitmap(vertices);
+		measure("bitmap", "fill", setting, vertices, [&](){ bitmap.fill(); });
+		measure("bitmap", "fill+clear", setting, vertices, [&](){ bitmap.fill(); bitmap.clear(); });
+
+		for (long partitions : partition_counts) {
+			// every window of a vertex vector, loaded and saved as the windowed streaming calls do
+			setting.partitions = partitions;
+			BigVector<float> data(path+"/bigvector", vertices);
+			data.fill(1.f);
+			measure("bigvector", "load+save", setting, vertices, [&](){
+				for (int p=0;p<partitions;p++) {
+					std::pair<VertexId,VertexId> range = get_partition_range(vertices, partitions, p);
+					data.load(range.first, range.second);
+					data.save();
+				}
+			});
+		}
+
+		for (std::string generator : {"rmat", "uniform"}) {
+			for (long partitions : partition_counts) {
+				std::string grid = path + "/" + generator + "-" + std::to_string(scale) + "-" + std::to_string(edge_factor) + "-" + std::to_string(partitions);
+				fprintf(stderr, "%s\n", grid.c_str());
+				write_grid(grid, generator, scale, edge_factor, partitions);
+				Graph graph(grid);
+				EdgeId edges = graph.edges;
+				BigVector<float> value(grid+"/value", vertices);
+				value.fill(1.f);
+				Bitmap active(vertices);
+				std::mt19937_64 rng(0);
+				for (VertexId i=0;i<vertices/10;i++) {
+					active.set_bit(rng() % vertices);
+				}
+				std::vector<long> counters(vertices);
+				std::vector<float> minimums(vertices);
+
+				for (long threads : thread_counts) {
+					graph.set_parallelism(threads);
+					Setting setting = {generator, (int)scale, edge_factor, (int)partitions, (int)threads, 0};
+					for (long budget : budgets) {
+						setting.budget_mb = budget;
+						graph.set_memory_bytes(budget==0 ? unlimited : budget * 1024l * 1024l);
+						for (int mode=0;mode<3;mode++) {
+							const char * variants[] = {"mode 0", "mode 1", "mode 2"};
+							measure("stream_edges", variants[mode], setting, edges, [&](){
+								graph.stream_edges<long>([&](UnweightedEdge & e){
+									return 1;
+								}, nullptr, 0, mode);
+							});
+						}
+					}
+					setting.budget_mb = 0;
+					graph.set_memory_bytes(unlimited);
+
+					measure("stream_vertices", "all", setting, vertices, [&](){
+						graph.stream_vertices<float>([&](VertexId i){
+							return value[i];
+						}, nullptr, 0.f);
+					});
+					measure("stream_vertices", "bitmap 10%", setting, vertices, [&](){
+						graph.stream_vertices<float>([&](VertexId i){
+							return value[i];
+						}, &active, 0.f);
+					});
+
+					// contention grows as the vertices share fewer slots
+					for (long slots : {1l, 64l, (long)vertices}) {
+						std::string variant = std::to_string(slots) + " slots";
+						measure("write_add", variant.c_str(), setting, vertices, [&](){
+							graph.stream_vertices<long>([&](VertexId i){
+								write_add(&counters[i % slots], 1l);
+								return 0;
+							});
+						});
+						measure("write_min", variant.c_str(), setting, vertices, [&](){
+							for (long k=0;k<slots;k++) minimums[k] = vertices;
+							graph.stream_vertices<long>([&](VertexId i){
+								write_min(&minimums[i % slots], (float)(vertices - i));
+								return 0;
+							});
+						});
+					}
+				}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// compares the std::function and the templated stream_edges/stream_vertices paths on a grid held in the page cache
+
+#include "core/graph.hpp"
+
+#include <random>
+
+void write_grid(std::string path, VertexId vertices, EdgeId edges, int partitions) {
+	if (file_exists(path)) {
+		remove_directory(path);
+	}
+	create_directory(path);
+	std::vector<std::vector<Edge> > blocks(partitions * partitions);
+	std::mt19937_64 rng(0);
+	for (EdgeId e=0;e<edges;e++) {
+		Edge edge;
+		edge.source = rng() % vertices;
+		edge.target = rng() % vertices;
+		edge.weight = 0;
+		int i = get_partition_id(vertices, partitions, edge.source);
+		int j = get_partition_id(vertices, partitions, edge.target);
+		blocks[i*partitions+j].push_back(edge);
+	}
+	const int edge_unit = sizeof(VertexId) * 2;
+	for (int layout=0;layout<2;layout++) {
+		FILE * fout = fopen((path+(layout==0?"/column":"/row")).c_str(), "wb");
+		FILE * fout_offset = fopen((path+(layout==0?"/column_offset":"/row_offset")).c_str(), "wb");
+		long offset = 0;
+		for (int a=0;a<partitions;a++) {
+			for (int b=0;b<partitions;b++) {
+				fwrite(&offset, sizeof(offset), 1, fout_offset);
+				std::vector<Edge> & block = (layout==0) ? blocks[b*partitions+a] : blocks[a*partitions+b];
+				for (Edge & edge : block) {
+					fwrite(&edge, edge_unit, 1, fout);
+				}
+				offset += block.size() * edge_unit;
+			}
+		}
+		fwrite(&offset, sizeof(offset), 1, fout_offset);
+		fclose(fout_offset);
+		fclose(fout);
+	}
+	FILE * fmeta = fopen((path+"/meta").c_str(), "w");
+	fprintf(fmeta, "%d %ld %ld %d %d", 0, (long)vertices, edges, partitions, (int)sizeof(VertexId));
+	fclose(fmeta);
+}
+
+int main(int argc, char ** argv) {
+	if (argc<2) {
+		fprintf(stderr, "usage: bench_kernel [scratch path] [vertices] [edges] [partitions] [repeats]\n");
+		exit(-1);
+	}
+	std::string path = argv[1];
+	VertexId vertices = (argc>=3)?atol(argv[2]):1000000;
+	EdgeId edges = (argc>=4)?atol(argv[3]):20000000;
+	int partitions = (argc>=5)?atoi(argv[4]):4;
+	int repeats = (argc>=6)?atoi(argv[5]):5;
+
+	write_grid(path, vertices, edges, partitions);
+	Graph graph(path);
+	int cores = std::thread::hardware_concurrency();
+	BigVector<float> pagerank(graph.path+"/pagerank", graph.vertices);
+	BigVector<float> sum(graph.path+"/sum", graph.vertices);
+	pagerank.fill(1.f);
+	sum.fill(0.f);
+
+	std::function<VertexId(Edge&)> f_count = [&](Edge & e){
+		return 1;
+	};
+	std::function<VertexId(Edge&)> f_pagerank = [&](Edge & e){
+		write_add(&sum[e.target], pagerank[e.source]);
+		return 0;
+	};
+	std::function<VertexId(VertexId)> f_vertex = [&](VertexId i){
+		pagerank[i] = 0.15f + 0.85f * sum[i];
+		return 1;
+	};
+
+	// warm up the page cache
+	graph.stream_edges(f_count, nullptr, 0, 1);
+
+	double start_time, elapsed;
+	for (int mode=0;mode<2;mode++) {
+		start_time = get_time();
+		for (int r=0;r<repeats;r++) {
+			if (mode==0) {
+				graph.stream_edges(f_count, nullptr, 0, 1);
+			} else {
+				graph.stream_edges<VertexId>([&](UnweightedEdge & e){
+					return 1;
+				}, nullptr, 0, 1);
+			}
+		}
+		elapsed = get_time() - start_time;
+		printf("count    %-13s %8.2f M edges/s/core\n", mode==0?"std::function":"template", 1e-6 * edges * repeats / elapsed / cores);
+
+		start_time = get_time();
+		for (int r=0;r<repeats;r++) {
+			if (mode==0) {
+				graph.stream_edges(f_pagerank, nullptr, 0, 1);
+			} else {
+				graph.stream_edges<VertexId>([&](UnweightedEdge & e){
+					write_add(&sum[e.target], pagerank[e.source]);
+					return 0;
+				}, nullptr, 0, 1);
+			}
+		}
+		elapsed = get_time() - start_time;
+		printf("pagerank %-13s %8.2f M edges/s/core\n", mode==0?"std::function":"template", 1e-6 * edges * repeats / elapsed / cores);
+
+		start_time = get_time();
+		for (int r=0;r<repeats;r++) {
+			if (mode==0) {
+				graph.stream_vertices(f_vertex);
+			} else {
+				graph.stream_vertices<VertexId>([&](VertexId i){
+					pagerank[i] = 0.15f + 0.85f * sum[i];
+					return 1;
+				});
+			}
+		}
+		elapsed = get_time() - start_time;
+		printf("vertices %-13s %8.2f M vertices/s/core\n", mode==0?"std::function":"template", 1e-6 * vertices * repeats / elapsed / cores);
+	}
+
+	return 0;
+}
@@ -0,0 +1,224 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+
+#include <string>
+#include <vector>
+
+#include "core/constants.hpp"
+#include "core/time.hpp"
+#include "core/delta.hpp"
+
+// copy length bytes between files, inside the kernel where supported
+void copy_range(int fin, long offset_in, int fout, long offset_out, long length, std::vector<char> & buffer) {
+	loff_t in = offset_in, out = offset_out;
+	while (length > 0 && buffer.empty()) {
+		ssize_t copied = copy_file_range(fin, &in, fout, &out, length, 0);
+		if (copied<=0) {
+			buffer.resize(IOSIZE); // not supported here: copy through user space
+			break;
+		}
+		length -= copied;
+	}
+	while (length > 0) {
+		long bytes = pread(fin, buffer.data(), std::min(length, (long)IOSIZE), in);
+		assert(bytes>0);
+		long written = pwrite(fout, buffer.data(), bytes, out);
+		assert(written==bytes);
+		in += bytes;
+		out += bytes;
+		length -= bytes;
+	}
+}
+
+// append the decoded frames of bytes [offset, offset+length) of a compressed file to edges
+void decode_range(int fin, long offset, long length, bool weighted, std::vector<Edge> & edges) {
+	std::vector<char> frames(length);
+	for (long pos=0;pos<length;) {
+		long bytes = pread(fin, frames.data()+pos, length-pos, offset+pos);
+		assert(bytes>0);
+		pos += bytes;
+	}
+	std::vector<VertexId> sources(FRAME_EDGES), targets(FRAME_EDGES);
+	for (long pos=0;pos<length;pos+=FRAME_SIZE) {
+		const Weight * weights;
+		int count = decode_frame(frames.data()+pos, weighted, sources.data(), targets.data(), weights);
+		for (int k=0;k<count;k++) {
+			Edge e;
+			e.source = sources[k];
+			e.target = targets[k];
+			e.weight = weighted ? weights[k] : 0;
+			edges.push_back(e);
+		}
+	}
+}
+
+void write_offsets(std::string filename, long * offset, int blocks) {
+	int fout = open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	long bytes = write(fout, offset, sizeof(long)*(blocks+1));
+	assert(bytes==(long)sizeof(long)*(blocks+1));
+	close(fout);
+}
+
+// merge the delta store of a grid into new row and column files. the new files are written next to the old
+// ones while inserts go on; only the final swap holds the delta lock, and edges appended in the meantime
+// stay in the delta store. graphs opened before the swap keep reading the old files until they are reopened.
+int main(int argc, char ** argv) {
+	if (argc<2) {
+		fprintf(stderr, "usage: compact [grid path]\n");
+		exit(-1);
+	}
+	std::string path = argv[1];
+
+	FILE * fin_meta = fopen((path+"/meta").c_str(), "r");
+	assert(fin_meta!=NULL);
+	int edge_type, partitions;
+	long vertices, edges;
+	int id_bytes = 4;
+	int fields = fscanf(fin_meta, "%d %ld %ld %d %d", &edge_type, &vertices, &edges, &partitions, &id_bytes);
+	assert(fields>=4);
+	fclose(fin_meta);
+	if (id_bytes!=(int)sizeof(VertexId)) {
+		fprintf(stderr, "%s has %d-byte vertex ids, but this build uses %d-byte ids (see GRIDGRAPH_VERTEX64)\n", path.c_str(), id_bytes, (int)sizeof(VertexId));
+		exit(-1);
+	}
+	bool weighted = is_weighted(edge_type);
+	bool compressed = is_compressed(edge_type);
+	const int blocks = partitions * partitions;
+
+	double start_time = get_time();
+	long * delta_bytes = new long [blocks];
+	int lock = lock_delta(path, LOCK_EX);
+	delta_sizes(path, partitions, delta_bytes);
+	unlock_delta(lock);
+	long merged_bytes = 0;
+	for (int ij=0;ij<blocks;ij++) {
+		merged_bytes += delta_bytes[ij];
+	}
+	if (merged_bytes==0) {
+		printf("no inserted edges to compact\n");
+		return 0;
+	}
+
+	long * row_offset = new long [blocks+1];
+	int fin = open((path+"/row_offset").c_str(), O_RDONLY);
+	long bytes = read(fin, row_offset, sizeof(long)*(blocks+1));
+	assert(bytes==(long)sizeof(long)*(blocks+1));
+	close(fin);
+
+	// the new row-oriented grid: every block followed by its deltas; compressed blocks with deltas are re-encoded
+	std::vector<char> buffer;
+	std::vector<Edge> block_edges;
+	std::vector<char> encoded;
+	long * new_row_offset = new long [blocks+1];
+	new_row_offset[0] = 0;
+	long merged_edges = 0;
+	int fin_row = open((path+"/row").c_str(), O_RDONLY);
+	int fout_row = open((path+"/row.compact").c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+	assert(fin_row!=-1 && fout_row!=-1);
+	for (int ij=0;ij<blocks;ij++) {
+		long base_bytes = row_offset[ij+1] - row_offset[ij];
+		long offset = new_row_offset[ij];
+		if (delta_bytes[ij]==0) {
+			copy_range(fin_row, row_offset[ij], fout_row, offset, base_bytes, buffer);
+			new_row_offset[ij+1] = offset + base_bytes;
+			continue;
+		}
+		int fin_delta = open(delta_file(path, ij / partitions, ij % partitions).c_str(), O_RDONLY);
+		assert(fin_delta!=-1);
+		merged_edges += delta_edges(fin_delta, delta_bytes[ij], edge_type);
+		if (!compressed) {
+			copy_range(fin_row, row_offset[ij], fout_row, offset, base_bytes, buffer);
+			copy_range(fin_delta, 0, fout_row, offset + base_bytes, delta_bytes[ij], buffer);
+			new_row_offset[ij+1] = offset + base_bytes + delta_bytes[ij];
+		} else {
+			block_edges.clear();
+			decode_range(fin_row, row_offset[ij], base_bytes, weighted, block_edges);
+			decode_range(fin_delta, 0, delta_bytes[ij], weighted, block_edges);
+			encode_edges(block_edges, edge_type, encoded);
+			long written = pwrite(fout_row, encoded.data(), encoded.size(), offset);
+			assert(written==(long)encoded.size());
+			new_row_offset[ij+1] = offset + encoded.size();
+		}
+		close(fin_delta);
+	}
+	close(fin_row);
+
+	// the column-oriented grid is the same blocks in column order
+	long * new_column_offset = new long [blocks+1];
+	new_column_offset[0] = 0;
+	int fout_column = open((path+"/column.compact").c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	assert(fout_column!=-1);
+	for (int j=0;j<partitions;j++) {
+		for (int i=0;i<partitions;i++) {
+			int ij = i*partitions+j;
+			int ji = j*partitions+i;
+			long length = new_row_offset[ij+1] - new_row_offset[ij];
+			copy_range(fout_row, new_row_offset[ij], fout_column, new_column_offset[ji], length, buffer);
+			new_column_offset[ji+1] = new_column_offset[ji] + length;
+		}
+	}
+	fsync(fout_row);
+	fsync(fout_column);
+	close(fout_row);
+	close(fout_column);
+	write_offsets(path+"/row_offset.compact", new_row_offset, blocks);
+	write_offsets(path+"/column_offset.compact", new_column_offset, blocks);
+	FILE * fmeta = fopen((path+"/meta.compact").c_str(), "w");
+	fprintf(fmeta, "%d %ld %ld %d %d", edge_type, vertices, edges + merged_edges, partitions, (int)sizeof(VertexId));
+	fclose(fmeta);
+
+	// swap: edges appended since the snapshot become the new deltas
+	lock = lock_delta(path, LOCK_EX);
+	for (int ij=0;ij<blocks;ij++) {
+		if (delta_bytes[ij]==0) continue;
+		std::string filename = delta_file(path, ij / partitions, ij % partitions);
+		long tail_bytes = file_size(filename) - delta_bytes[ij];
+		if (tail_bytes > 0) {
+			int fin_delta = open(filename.c_str(), O_RDONLY);
+			int fout_tail = open((filename+".tail").c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+			assert(fin_delta!=-1 && fout_tail!=-1);
+			copy_range(fin_delta, delta_bytes[ij], fout_tail, 0, tail_bytes, buffer);
+			close(fout_tail);
+			close(fin_delta);
+			int ret = rename((filename+".tail").c_str(), filename.c_str());
+			assert(ret==0);
+		} else {
+			unlink(filename.c_str());
+		}
+	}
+	const char * files[] = {"row", "column", "row_offset", "column_offset", "meta"};
+	for (auto file : files) {
+		int ret = rename((path+"/"+file+".compact").c_str(), (path+"/"+file).c_str());
+		assert(ret==0);
+	}
+	// both caches were derived from the old grid
+	unlink((path+"/block_groups").c_str());
+	unlink((path+"/out_degree").c_str());
+	unlock_delta(lock);
+
+	printf("merged %ld inserted edges (%ld bytes) into %ld edges in %.2f seconds\n", merged_edges, merged_bytes, edges + merged_edges, get_time() - start_time);
+	delete [] new_column_offset;
+	delete [] new_row_offset;
+	delete [] row_offset;
+	delete [] delta_bytes;
+	return 0;
+}
@@ -1,23 +1,270 @@
-#include <fstream>
-#include <iostream>
-#include <fcntl.h>
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// converts a text edge list ("source target [weight]" per line, '#' and '%' start comments) into the
+// binary edge list read by preprocess (and by Mosaic): chunks of the mmapped input are parsed in parallel
+// and written back in input order
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+
+#include "core/type.hpp"
+#include "core/time.hpp"
+
+const long TEXT_CHUNK = 16l*1024l*1024l;
+
+inline bool is_blank(char c) {
+	return c==' ' || c=='\t' || c==',' || c=='\r';
+}
+
+// parse one edge starting at p (not past end); returns false for blank and comment lines.
+// p is left at the beginning of the next line.
+inline bool parse_line(const char * & p, const char * end, bool weighted, VertexId & source, VertexId & target, Weight & weight) {
+	while (p<end && is_blank(*p)) p++;
+	if (p==end || *p=='\n' || *p=='#' || *p=='%') {
+		while (p<end && *p!='\n') p++;
+		if (p<end) p++;
+		return false;
+	}
+	VertexId * ids[2] = {&source, &target};
+	for (int k=0;k<2;k++) {
+		while (p<end && is_blank(*p)) p++;
+		if (p==end || *p<'0' || *p>'9') {
+			fprintf(stderr, "malformed edge near \"%.*s\"\n", (int)std::min((long)(end-p), 32l), p);
+			exit(-1);
+		}
+		unsigned long value = 0;
+		while (p<end && *p>='0' && *p<='9') {
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		if (value > (unsigned long)std::numeric_limits<VertexId>::max()) {
+			fprintf(stderr, "vertex id %lu does not fit in %d bytes; rebuild with VERTEX64=1\n", value, (int)sizeof(VertexId));
+			exit(-1);
+		}
+		*ids[k] = value;
+	}
+	if (weighted) {
+		while (p<end && is_blank(*p)) p++;
+		if (p<end && *p!='\n') {
+			const char * start = p;
+			bool negative = (*p=='-');
+			if (*p=='-' || *p=='+') p++;
+			double value = 0;
+			int digits = 0;
+			while (p<end && *p>='0' && *p<='9') {
+				value = value * 10 + (*p - '0');
+				digits++;
+				p++;
+			}
+			if (p<end && *p=='.') {
+				p++;
+				double scale = 0.1;
+				while (p<end && *p>='0' && *p<='9') {
+					value += (*p - '0') * scale;
+					scale *= 0.1;
+					digits++;
+					p++;
+				}
+			}
+			bool malformed = (digits==0);
+			if (p<end && (*p=='e' || *p=='E')) {
+				p++;
+				bool negative_exponent = (p<end && *p=='-');
+				if (p<end && (*p=='-' || *p=='+')) p++;
+				int exponent = 0;
+				if (p==end || *p<'0' || *p>'9') malformed = true;
+				while (p<end && *p>='0' && *p<='9') {
+					exponent = exponent * 10 + (*p - '0');
+					p++;
+				}
+				double base = negative_exponent ? 0.1 : 10;
+				for (;exponent>0;exponent--) value *= base;
+			}
+			if (p<end && *p!='\n' && !is_blank(*p)) malformed = true;
+			if (malformed) {
+				fprintf(stderr, "malformed weight near \"%.*s\"\n", (int)std::min((long)(end-start), 32l), start);
+				exit(-1);
+			}
+			weight = negative ? -value : value;
+		} else {
+			weight = 1;
+		}
+	}
+	while (p<end && *p!='\n') p++;
+	if (p<end) p++;
+	return true;
+}
+
+void write_all(int fd, const char * buffer, long bytes) {
+	while (bytes>0) {
+		long written = write(fd, buffer, bytes);
+		if (written==-1 && errno==EINTR) continue;
+		assert(written>0);
+		buffer += written;
+		bytes -= written;
+	}
+}
+
+int main(int argc, char ** argv) {
+	int opt;
+	std::string input = "";
+	std::string output = "";
+	bool weighted = false;
+	bool undirected = false;
+	int parallelism = std::thread::hardware_concurrency();
+	while ((opt = getopt(argc, argv, "i:o:wut:")) != -1) {
+		switch (opt) {
+		case 'i':
+			input = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'w':
+			weighted = true;
+			break;
+		case 'u':
+			undirected = true;
+			break;
+		case 't':
+			parallelism = atoi(optarg);
+			break;
+		}
+	}
+	if (input=="" || output=="" || parallelism<1) {
+		fprintf(stderr, "usage: %s -i [input path] -o [output path] [-w: weighted] [-u: undirected, emit both directions] [-t threads]\n", argv[0]);
+		exit(-1);
+	}
+
+	int fin = open(input.c_str(), O_RDONLY);
+	if (fin==-1) printf("%s\n", strerror(errno));
+	assert(fin!=-1);
+	struct stat st;
+	int ret = fstat(fin, &st);
+	assert(ret==0);
+	long text_bytes = st.st_size;
+	const char * text = NULL;
+	if (text_bytes>0) {
+		text = (const char *)mmap(NULL, text_bytes, PROT_READ, MAP_PRIVATE, fin, 0);
+		assert(text!=MAP_FAILED);
+		madvise((void *)text, text_bytes, MADV_SEQUENTIAL);
+	}
+	int fout = open(output.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	assert(fout!=-1);
+
+	// chunk k covers the lines starting in [k * TEXT_CHUNK, (k + 1) * TEXT_CHUNK)
+	long chunks = (text_bytes + TEXT_CHUNK - 1) / TEXT_CHUNK;
+	const int edge_unit = weighted ? sizeof(VertexId) * 2 + sizeof(Weight) : sizeof(VertexId) * 2;
+	long next_chunk = 0;
+	long next_write = 0;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<EdgeId> edges(parallelism, 0);
+	std::vector<VertexId> max_id(parallelism, -1);
+
+	double start_time = get_time();
+	std::vector<std::thread> threads;
+	for (int ti=0;ti<parallelism;ti++) {
+		threads.emplace_back([&](int thread_id){
+			long capacity = TEXT_CHUNK * 2;
+			char * buffer = (char *)malloc(capacity);
+			assert(buffer!=NULL);
+			long k;
+			while ((k = __sync_fetch_and_add(&next_chunk, 1)) < chunks) {
+				const char * begin = text + k * TEXT_CHUNK;
+				const char * end = text + std::min((k + 1) * TEXT_CHUNK, text_bytes);
+				// a line belongs to the chunk it starts in
+				if (k > 0 && begin[-1]!='\n') {
+					while (begin<end && *begin!='\n') begin++;
+					if (begin<end) begin++;
+				}
+				if (begin<end) {
+					while (end<text+text_bytes && end[-1]!='\n') end++;
+				}
+				long bytes = 0;
+				VertexId source, target;
+				Weight weight = 0;
+				const char * p = begin;
+				while (p<end) {
+					if (!parse_line(p, end, weighted, source, target, weight)) continue;
+					if (bytes + edge_unit * 2 > capacity) {
+						capacity *= 2;
+						buffer = (char *)realloc(buffer, capacity);
+						assert(buffer!=NULL);
+					}
+					for (int d=0;d<(undirected?2:1);d++) {
+						*(VertexId*)(buffer+bytes) = d==0 ? source : target;
+						*(VertexId*)(buffer+bytes+sizeof(VertexId)) = d==0 ? target : source;
+						if (weighted) {
+							*(Weight*)(buffer+bytes+sizeof(VertexId)*2) = weight;
+						}
+						bytes += edge_unit;
+					}
+					max_id[thread_id] = std::max(max_id[thread_id], std::max(source, target));
+				}
+				edges[thread_id] += bytes / edge_unit;
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&]{ return next_write==k; });
+				lock.unlock();
+				write_all(fout, buffer, bytes);
+				lock.lock();
+				next_write++;
+				cond.notify_all();
+				if (thread_id==0) {
+					printf("progress: %.2f%%\r", 100. * next_write / chunks);
+					fflush(stdout);
+				}
+			}
+			free(buffer);
+		}, ti);
+	}
+	for (int ti=0;ti<parallelism;ti++) {
+		threads[ti].join();
+	}
+	printf("\n");
+	close(fout);
+	if (text!=NULL) {
+		munmap((void *)text, text_bytes);
+	}
+	close(fin);
 
-int main(int argc, char** argv) {
-  std::fstream file("$HOME/cit-Patents/cit-Patents.e");
-  int fd = open("../data/citpatents", O_WRONLY | O_CREAT);
-  int edge_count = 0;
-  int c = 1;
-  int64_t write_bytes = 0;
-  while (!file.eof()) {
-    int32_t src, dst;
-    file >> src >> dst;
-    edge_count++;
-    write_bytes += write(fd, &src, sizeof(src));
-    write_bytes += write(fd, &dst, sizeof(dst));
-  }
-  std::cout << "write bytes: " << write_bytes << std::endl;
-  std::cout << "edge count: " << edge_count << std::endl;
-  close(fd);
-  return 0;
-}
\ No newline at end of file
+	EdgeId total_edges = 0;
+	VertexId vertices = 0;
+	for (int ti=0;ti<parallelism;ti++) {
+		total_edges += edges[ti];
+		if (max_id[ti] + 1 > vertices) {
+			vertices = max_id[ti] + 1;
+		}
+	}
+	printf("converted %ld edges in %.2f seconds\n", total_edges, get_time() - start_time);
+	printf("vertices = %ld (largest id + 1), edge type = %d\n", (long)vertices, weighted ? 1 : 0);
+	return 0;
+}
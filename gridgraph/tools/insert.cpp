@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include <string>
+
+#include "core/constants.hpp"
+#include "core/time.hpp"
+#include "core/delta.hpp"
+
+// append a binary edge list (the preprocess input layout of the grid's edge type) to the delta store of a grid
+int main(int argc, char ** argv) {
+	if (argc<3) {
+		fprintf(stderr, "usage: insert [grid path] [edge list path]\n");
+		exit(-1);
+	}
+	std::string path = argv[1];
+	std::string input = argv[2];
+
+	FILE * fin_meta = fopen((path+"/meta").c_str(), "r");
+	assert(fin_meta!=NULL);
+	int edge_type, partitions;
+	long vertices, edges;
+	int id_bytes = 4;
+	int fields = fscanf(fin_meta, "%d %ld %ld %d %d", &edge_type, &vertices, &edges, &partitions, &id_bytes);
+	assert(fields>=4);
+	fclose(fin_meta);
+	if (id_bytes!=(int)sizeof(VertexId)) {
+		fprintf(stderr, "%s has %d-byte vertex ids, but this build uses %d-byte ids (see GRIDGRAPH_VERTEX64)\n", path.c_str(), id_bytes, (int)sizeof(VertexId));
+		exit(-1);
+	}
+	int edge_unit = is_weighted(edge_type) ? sizeof(VertexId) * 2 + sizeof(Weight) : sizeof(VertexId) * 2;
+
+	// a relabeled grid takes input ids, like preprocess; only the pages of the inserted ids are read
+	VertexId * new_id = NULL;
+	if (file_exists(path+"/permutation")) {
+		int fin = open((path+"/permutation").c_str(), O_RDONLY);
+		assert(fin!=-1);
+		new_id = (VertexId *)mmap(NULL, sizeof(VertexId) * vertices, PROT_READ, MAP_PRIVATE, fin, 0);
+		assert(new_id!=MAP_FAILED);
+		close(fin);
+	}
+
+	double start_time = get_time();
+	int fin = open(input.c_str(), O_RDONLY);
+	assert(fin!=-1);
+	const long chunk_size = IOSIZE / edge_unit * edge_unit;
+	char * buffer = (char *)malloc(chunk_size);
+	long inserted = 0;
+	while (true) {
+		long bytes = read(fin, buffer, chunk_size);
+		assert(bytes!=-1);
+		if (bytes==0) break;
+		assert(bytes % edge_unit==0);
+		if (new_id!=NULL) {
+			for (long pos=0;pos<bytes;pos+=edge_unit) {
+				VertexId * edge = (VertexId*)(buffer+pos);
+				assert(edge[0]>=0 && edge[0]<vertices && edge[1]>=0 && edge[1]<vertices);
+				edge[0] = new_id[edge[0]];
+				edge[1] = new_id[edge[1]];
+			}
+		}
+		insert_edges(path, edge_type, vertices, partitions, buffer, bytes);
+		inserted += bytes / edge_unit;
+	}
+	close(fin);
+	free(buffer);
+	if (new_id!=NULL) {
+		munmap(new_id, sizeof(VertexId) * vertices);
+	}
+	printf("inserted %ld edges in %.2f seconds\n", inserted, get_time() - start_time);
+	return 0;
+}
@@ -20,13 +20,19 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include <fcntl.h>
 #include <malloc.h>
 #include <errno.h>
+#include <omp.h>
+#include <sys/mman.h>
 #include <assert.h>
 #include <string.h>
+#include <math.h>
 #include <iostream>
 
 #include <string>
+#include <algorithm>
 #include <vector>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "core/constants.hpp"
 #include "core/type.hpp"
@@ -35,236 +41,639 @@ Copyright (c) 2014-2015 Xiaowei Zhu, Tsinghua University
 #include "core/partition.hpp"
 #include "core/time.hpp"
 #include "core/atomic.hpp"
+#include "core/compress.hpp"
 
 long PAGESIZE = 4096;
 
-void generate_edge_grid(std::string input, std::string output, VertexId vertices, int partitions, int edge_type) {
-	int parallelism = std::thread::hardware_concurrency();
-	int edge_unit;
-	EdgeId edges;
-	switch (edge_type) {
-	case 0:
-		edge_unit = sizeof(VertexId) * 2;
-		edges = file_size(input) / edge_unit;
-		break;
-	case 1:
-		edge_unit = sizeof(VertexId) * 2 + sizeof(Weight);
-		edges = file_size(input) / edge_unit;
-		break;
-	default:
-		fprintf(stderr, "edge type (%d) is not supported.\n", edge_type);
-		exit(-1);
-	}
-	printf("vertices = %d, edges = %ld\n", vertices, edges);
-
-	char ** buffers = new char * [parallelism*2];
+// read the input once, handing chunks of at most IOSIZE bytes to parallelism workers: process(thread_id, buffer, bytes).
+// every chunk holds whole records of edge_unit bytes
+template <typename F>
+void scan_input(std::string input, int parallelism, int queue_type, char ** buffers, int edge_unit, const char * step, F process) {
 	bool * occupied = new bool [parallelism*2];
 	for (int i=0;i<parallelism*2;i++) {
-		buffers[i] = (char *)memalign(PAGESIZE, IOSIZE);
 		occupied[i] = false;
 	}
-	Queue<std::tuple<int, long> > tasks(parallelism);
-	int ** fout;
-	std::mutex ** mutexes;
-	fout = new int * [partitions];
-	mutexes = new std::mutex * [partitions];
-	if (file_exists(output)) {
-		remove_directory(output);
-	}
-	create_directory(output);
-
-	const int grid_buffer_size = 768; // 12 * 8 * 8
-	char * global_grid_buffer = (char *) memalign(PAGESIZE, grid_buffer_size * partitions * partitions);
-	char *** grid_buffer = new char ** [partitions];
-	int ** grid_buffer_offset = new int * [partitions];
-	for (int i=0;i<partitions;i++) {
-		mutexes[i] = new std::mutex [partitions];
-		fout[i] = new int [partitions];
-		grid_buffer[i] = new char * [partitions];
-		grid_buffer_offset[i] = new int [partitions];
-		for (int j=0;j<partitions;j++) {
-			char filename[4096];
-			sprintf(filename, "%s/block-%d-%d", output.c_str(), i, j);
-			fout[i][j] = open(filename, O_WRONLY|O_APPEND|O_CREAT, 0644);
-			grid_buffer[i][j] = global_grid_buffer + (i * partitions + j) * grid_buffer_size;
-			grid_buffer_offset[i][j] = 0;
-		}
-	}
-
+	TaskQueue<std::tuple<int, long> > tasks(parallelism, queue_type);
 	std::vector<std::thread> threads;
 	for (int ti=0;ti<parallelism;ti++) {
-		threads.emplace_back([&]() {
-			char * local_buffer = (char *) memalign(PAGESIZE, IOSIZE);
-			int * local_grid_offset = new int [partitions * partitions];
-			int * local_grid_cursor = new int [partitions * partitions];
-			VertexId source, target;
-			Weight weight;
+		threads.emplace_back([&](int thread_id) {
 			while (true) {
 				int cursor;
 				long bytes;
 				std::tie(cursor, bytes) = tasks.pop();
 				if (cursor==-1) break;
-				memset(local_grid_offset, 0, sizeof(int) * partitions * partitions);
-				memset(local_grid_cursor, 0, sizeof(int) * partitions * partitions);
-				char * buffer = buffers[cursor];
-				for (long pos=0;pos<bytes;pos+=edge_unit) {
-					source = *(VertexId*)(buffer+pos);
-					target = *(VertexId*)(buffer+pos+sizeof(VertexId));
-					int i = get_partition_id(vertices, partitions, source);
-					int j = get_partition_id(vertices, partitions, target);
-					local_grid_offset[i*partitions+j] += edge_unit;
-				}
-				local_grid_cursor[0] = 0;
-				for (int ij=1;ij<partitions*partitions;ij++) {
-					local_grid_cursor[ij] = local_grid_offset[ij - 1];
-					local_grid_offset[ij] += local_grid_cursor[ij];
-				}
-				// assert(local_grid_offset[partitions*partitions-1]==bytes);
-				for (long pos=0;pos<bytes;pos+=edge_unit) {
-					source = *(VertexId*)(buffer+pos);
-					target = *(VertexId*)(buffer+pos+sizeof(VertexId));
-					int i = get_partition_id(vertices, partitions, source);
-					int j = get_partition_id(vertices, partitions, target);
-					*(VertexId*)(local_buffer+local_grid_cursor[i*partitions+j]) = source;
-					*(VertexId*)(local_buffer+local_grid_cursor[i*partitions+j]+sizeof(VertexId)) = target;
-					if (edge_type==1) {
-						weight = *(Weight*)(buffer+pos+sizeof(VertexId)*2);
-						*(Weight*)(local_buffer+local_grid_cursor[i*partitions+j]+sizeof(VertexId)*2) = weight;
-					}
-					local_grid_cursor[i*partitions+j] += edge_unit;
-				}
-				int start = 0;
-				for (int ij=0;ij<partitions*partitions;ij++) {
-					// assert(local_grid_cursor[ij]==local_grid_offset[ij]);
-					int i = ij / partitions;
-					int j = ij % partitions;
-					std::unique_lock<std::mutex> lock(mutexes[i][j]);
-					if (local_grid_offset[ij] - start > edge_unit) {
-						write(fout[i][j], local_buffer+start, local_grid_offset[ij]-start);
-					} else if (local_grid_offset[ij] - start == edge_unit) {
-						memcpy(grid_buffer[i][j]+grid_buffer_offset[i][j], local_buffer+start, edge_unit);
-						grid_buffer_offset[i][j] += edge_unit;
-						if (grid_buffer_offset[i][j]==grid_buffer_size) {
-							write(fout[i][j], grid_buffer[i][j], grid_buffer_size);
-							grid_buffer_offset[i][j] = 0;
-						}
-					}
-					start = local_grid_offset[ij];
-				}
-				occupied[cursor] = false;
+				process(thread_id, buffers[cursor], bytes);
+				__atomic_store_n(&occupied[cursor], false, __ATOMIC_RELEASE);
 			}
-		});
+		}, ti);
 	}
 
 	int fin = open(input.c_str(), O_RDONLY);
 	if (fin==-1) printf("%s\n", strerror(errno));
 	assert(fin!=-1);
+	posix_fadvise(fin, 0, 0, POSIX_FADV_SEQUENTIAL);
 	int cursor = 0;
 	long total_bytes = file_size(input);
 	long read_bytes = 0;
-	double start_time = get_time();
+	const long chunk_size = IOSIZE / edge_unit * edge_unit;
 	while (true) {
-		long bytes = read(fin, buffers[cursor], IOSIZE);
+		long bytes = read(fin, buffers[cursor], chunk_size);
 		assert(bytes!=-1);
 		if (bytes==0) break;
+		assert(bytes % edge_unit==0);
 		occupied[cursor] = true;
 		tasks.push(std::make_tuple(cursor, bytes));
 		read_bytes += bytes;
-		printf("progress: %.2f%%\r", 100. * read_bytes / total_bytes);
+		printf("%s: %.2f%%\r", step, 100. * read_bytes / total_bytes);
 		fflush(stdout);
-		while (occupied[cursor]) {
+		while (__atomic_load_n(&occupied[cursor], __ATOMIC_ACQUIRE)) {
 			cursor = (cursor + 1) % (parallelism * 2);
 		}
 	}
 	close(fin);
-	// printf("%d %d %d\n", read_bytes, edges, edge_unit);
-	// assert(read_bytes==edges*edge_unit);
+	printf("\n");
 
 	for (int ti=0;ti<parallelism;ti++) {
 		tasks.push(std::make_tuple(-1, 0));
 	}
-
 	for (int ti=0;ti<parallelism;ti++) {
 		threads[ti].join();
 	}
+	delete [] occupied;
+}
+
+#define ORDER_NONE 0
+#define ORDER_DEGREE 1
+#define ORDER_RCM 2
+#define ORDER_GORDER 3
+
+const int GORDER_WINDOW = 5;
+
+// in- and out-adjacency of the input in memory
+struct Adjacency {
+	EdgeId * out_offset;
+	VertexId * out;
+	EdgeId * in_offset;
+	VertexId * in;
+	VertexId degree(VertexId v) {
+		return (out_offset[v+1] - out_offset[v]) + (in_offset[v+1] - in_offset[v]);
+	}
+};
 
-	printf("%lf -> ", get_time() - start_time);
-	long ts = 0;
-	for (int i=0;i<partitions;i++) {
-		for (int j=0;j<partitions;j++) {
-			if (grid_buffer_offset[i][j]>0) {
-				ts += grid_buffer_offset[i][j];
-				write(fout[i][j], grid_buffer[i][j], grid_buffer_offset[i][j]);
+// builds both adjacencies from the mmapped input. every thread counts and then fills the lists of a fixed
+// range of edges, starting at its own per-vertex offsets, so no atomics are needed and every list keeps the
+// input order. the per-thread counters are limited to the size of the adjacency itself.
+void load_adjacency(std::string input, VertexId vertices, int edge_unit, Adjacency & adjacency) {
+	int fin = open(input.c_str(), O_RDONLY);
+	assert(fin!=-1);
+	long bytes = file_size(input);
+	EdgeId edges = bytes / edge_unit;
+	char * data = NULL;
+	if (bytes > 0) {
+		data = (char *)mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fin, 0);
+		assert(data!=MAP_FAILED);
+		madvise(data, bytes, MADV_SEQUENTIAL);
+	}
+	int threads = std::max(1, (int)std::min((EdgeId)std::thread::hardware_concurrency(), edges / std::max(vertices, (VertexId)1)));
+	EdgeId ** out_cursor = new EdgeId * [threads];
+	EdgeId ** in_cursor = new EdgeId * [threads];
+	#pragma omp parallel num_threads(threads)
+	{
+		int t = omp_get_thread_num();
+		out_cursor[t] = new EdgeId [vertices]();
+		in_cursor[t] = new EdgeId [vertices]();
+		for (EdgeId e=edges*t/threads;e<edges*(t+1)/threads;e++) {
+			out_cursor[t][*(VertexId*)(data+e*edge_unit)]++;
+			in_cursor[t][*(VertexId*)(data+e*edge_unit+sizeof(VertexId))]++;
+		}
+	}
+	adjacency.out_offset = new EdgeId [vertices+1];
+	adjacency.in_offset = new EdgeId [vertices+1];
+	adjacency.out_offset[0] = 0;
+	adjacency.in_offset[0] = 0;
+	for (VertexId v=0;v<vertices;v++) {
+		EdgeId out_offset = adjacency.out_offset[v];
+		EdgeId in_offset = adjacency.in_offset[v];
+		for (int t=0;t<threads;t++) {
+			EdgeId out_count = out_cursor[t][v];
+			EdgeId in_count = in_cursor[t][v];
+			out_cursor[t][v] = out_offset;
+			in_cursor[t][v] = in_offset;
+			out_offset += out_count;
+			in_offset += in_count;
+		}
+		adjacency.out_offset[v+1] = out_offset;
+		adjacency.in_offset[v+1] = in_offset;
+	}
+	adjacency.out = new VertexId [edges];
+	adjacency.in = new VertexId [edges];
+	#pragma omp parallel num_threads(threads)
+	{
+		int t = omp_get_thread_num();
+		for (EdgeId e=edges*t/threads;e<edges*(t+1)/threads;e++) {
+			VertexId source = *(VertexId*)(data+e*edge_unit);
+			VertexId target = *(VertexId*)(data+e*edge_unit+sizeof(VertexId));
+			adjacency.out[out_cursor[t][source]++] = target;
+			adjacency.in[in_cursor[t][target]++] = source;
+		}
+		delete [] out_cursor[t];
+		delete [] in_cursor[t];
+	}
+	delete [] out_cursor;
+	delete [] in_cursor;
+	if (data!=NULL) {
+		munmap(data, bytes);
+	}
+	close(fin);
+}
+
+// reverse Cuthill-McKee on the undirected graph: BFS from the lowest-degree unvisited vertex,
+// enqueueing neighbours by increasing degree, then reverse the order
+void order_rcm(VertexId vertices, Adjacency & adjacency, VertexId * order) {
+	VertexId * by_degree = new VertexId [vertices];
+	for (VertexId v=0;v<vertices;v++) {
+		by_degree[v] = v;
+	}
+	std::stable_sort(by_degree, by_degree+vertices, [&](VertexId a, VertexId b){
+		return adjacency.degree(a) < adjacency.degree(b);
+	});
+	bool * visited = new bool [vertices]();
+	VertexId tail = 0;
+	std::vector<VertexId> neighbours;
+	for (VertexId k=0;k<vertices;k++) {
+		VertexId start = by_degree[k];
+		if (visited[start]) continue;
+		visited[start] = true;
+		VertexId head = tail;
+		order[tail++] = start;
+		while (head<tail) {
+			VertexId u = order[head++];
+			neighbours.clear();
+			for (EdgeId e=adjacency.out_offset[u];e<adjacency.out_offset[u+1];e++) {
+				if (!visited[adjacency.out[e]]) {
+					visited[adjacency.out[e]] = true;
+					neighbours.push_back(adjacency.out[e]);
+				}
+			}
+			for (EdgeId e=adjacency.in_offset[u];e<adjacency.in_offset[u+1];e++) {
+				if (!visited[adjacency.in[e]]) {
+					visited[adjacency.in[e]] = true;
+					neighbours.push_back(adjacency.in[e]);
+				}
+			}
+			std::sort(neighbours.begin(), neighbours.end(), [&](VertexId a, VertexId b){
+				VertexId degree_a = adjacency.degree(a), degree_b = adjacency.degree(b);
+				return degree_a < degree_b || (degree_a==degree_b && a < b);
+			});
+			for (VertexId v : neighbours) {
+				order[tail++] = v;
 			}
 		}
 	}
-	printf("%lf (%ld)\n", get_time() - start_time, ts);
+	std::reverse(order, order+vertices);
+	delete [] visited;
+	delete [] by_degree;
+}
 
-	for (int i=0;i<partitions;i++) {
-		for (int j=0;j<partitions;j++) {
-			close(fout[i][j]);
+// Gorder (Wei et al., SIGMOD'16): greedily place next the vertex with the most edges to, and common
+// in-neighbours with, the last GORDER_WINDOW placed vertices. scores change by one at a time, so unplaced
+// vertices are kept in doubly linked buckets by score. hubs (more than sqrt(vertices) edges
+// in the relevant direction) are not expanded into siblings.
+void order_gorder(VertexId vertices, Adjacency & adjacency, VertexId * order) {
+	VertexId * score = new VertexId [vertices]();
+	VertexId * next = new VertexId [vertices];
+	VertexId * prev = new VertexId [vertices];
+	bool * placed = new bool [vertices]();
+	std::vector<VertexId> head(1, -1);
+	VertexId top = 0;
+	EdgeId hub = (EdgeId)sqrt((double)vertices);
+	for (VertexId v=vertices-1;v>=0;v--) {
+		prev[v] = -1;
+		next[v] = head[0];
+		if (head[0]!=-1) prev[head[0]] = v;
+		head[0] = v;
+	}
+	auto unlink = [&](VertexId v){
+		if (prev[v]!=-1) next[prev[v]] = next[v]; else head[score[v]] = next[v];
+		if (next[v]!=-1) prev[next[v]] = prev[v];
+	};
+	auto update = [&](VertexId v, int delta){
+		if (placed[v]) return;
+		unlink(v);
+		score[v] += delta;
+		if (score[v]>=(VertexId)head.size()) head.resize(score[v]+1, -1);
+		prev[v] = -1;
+		next[v] = head[score[v]];
+		if (next[v]!=-1) prev[next[v]] = v;
+		head[score[v]] = v;
+		if (score[v]>top) top = score[v];
+	};
+	auto apply = [&](VertexId u, int delta){
+		for (EdgeId e=adjacency.out_offset[u];e<adjacency.out_offset[u+1];e++) {
+			update(adjacency.out[e], delta);
+		}
+		bool siblings = adjacency.in_offset[u+1] - adjacency.in_offset[u] <= hub;
+		for (EdgeId e=adjacency.in_offset[u];e<adjacency.in_offset[u+1];e++) {
+			VertexId x = adjacency.in[e];
+			update(x, delta);
+			if (!siblings || adjacency.out_offset[x+1] - adjacency.out_offset[x] > hub) continue;
+			for (EdgeId f=adjacency.out_offset[x];f<adjacency.out_offset[x+1];f++) {
+				if (adjacency.out[f]!=u) update(adjacency.out[f], delta);
+			}
 		}
+	};
+	VertexId start = 0;
+	for (VertexId v=1;v<vertices;v++) {
+		if (adjacency.in_offset[v+1] - adjacency.in_offset[v] > adjacency.in_offset[start+1] - adjacency.in_offset[start]) start = v;
 	}
+	for (VertexId k=0;k<vertices;k++) {
+		VertexId v = start;
+		if (k > 0) {
+			while (head[top]==-1) top--;
+			v = head[top];
+		}
+		unlink(v);
+		placed[v] = true;
+		order[k] = v;
+		apply(v, 1);
+		if (k >= GORDER_WINDOW) {
+			apply(order[k-GORDER_WINDOW], -1);
+		}
+		if (k % 65536==0) {
+			printf("ordering: %.2f%%\r", 100. * k / vertices);
+			fflush(stdout);
+		}
+	}
+	printf("\n");
+	delete [] placed;
+	delete [] prev;
+	delete [] next;
+	delete [] score;
+}
+
+// returns the new id of every input vertex
+VertexId * relabel(std::string input, VertexId vertices, int edge_type, int ordering) {
+	int edge_unit = is_weighted(edge_type) ? sizeof(VertexId) * 2 + sizeof(Weight) : sizeof(VertexId) * 2;
+	double start_time = get_time();
+	Adjacency adjacency;
+	load_adjacency(input, vertices, edge_unit, adjacency);
+	VertexId * order = new VertexId [vertices]; // order[k] is the input vertex that gets id k
+	switch (ordering) {
+	case ORDER_DEGREE:
+		for (VertexId v=0;v<vertices;v++) {
+			order[v] = v;
+		}
+		std::stable_sort(order, order+vertices, [&](VertexId a, VertexId b){
+			return adjacency.degree(a) > adjacency.degree(b);
+		});
+		break;
+	case ORDER_RCM:
+		order_rcm(vertices, adjacency, order);
+		break;
+	case ORDER_GORDER:
+		order_gorder(vertices, adjacency, order);
+		break;
+	default:
+		fprintf(stderr, "vertex ordering (%d) is not supported.\n", ordering);
+		exit(-1);
+	}
+	VertexId * new_id = new VertexId [vertices];
+	for (VertexId k=0;k<vertices;k++) {
+		new_id[order[k]] = k;
+	}
+	delete [] order;
+	delete [] adjacency.out_offset;
+	delete [] adjacency.out;
+	delete [] adjacency.in_offset;
+	delete [] adjacency.in;
+	printf("it takes %.2f seconds to relabel vertices\n", get_time() - start_time);
+	return new_id;
+}
+
+void write_offsets(std::string filename, long * offset, int blocks) {
+	int fout = open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	long bytes = write(fout, offset, sizeof(long)*(blocks+1));
+	assert(bytes==(long)sizeof(long)*(blocks+1));
+	close(fout);
+}
+
+// re-encode the raw row-oriented grid into frames (edge types 2 and 3). runs of up to 4 * IOSIZE bytes of a
+// block are sorted by source and encoded by parallel workers, then appended in block order; the column-oriented
+// grid is the same blocks in column order, copied inside the kernel where possible.
+void compress_grid(std::string output, int partitions, int edge_type) {
+	int parallelism = std::thread::hardware_concurrency();
+	bool weighted = is_weighted(edge_type);
+	int edge_unit = weighted ? sizeof(VertexId) * 2 + sizeof(Weight) : sizeof(VertexId) * 2;
+	const int blocks = partitions * partitions;
+	long * raw_offset = new long [blocks+1];
+	int fin = open((output+"/row_offset").c_str(), O_RDONLY);
+	long bytes = read(fin, raw_offset, sizeof(long)*(blocks+1));
+	assert(bytes==(long)sizeof(long)*(blocks+1));
+	close(fin);
 
-	printf("it takes %.2f seconds to generate edge blocks\n", get_time() - start_time);
+	const long run_bytes = IOSIZE / edge_unit * edge_unit * 4;
+	std::vector<std::tuple<int, long, long> > runs;
+	for (int ij=0;ij<blocks;ij++) {
+		for (long begin=raw_offset[ij];begin<raw_offset[ij+1];begin+=run_bytes) {
+			runs.push_back(std::make_tuple(ij, begin, std::min(begin+run_bytes, raw_offset[ij+1])));
+		}
+	}
+	fin = open((output+"/row").c_str(), O_RDONLY);
+	int fout = open((output+"/row.compressed").c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	assert(fin!=-1 && fout!=-1);
+	long * row_offset = new long [blocks+1];
+	int next_block = 0; // blocks before next_block have their row_offset set
+	long write_offset = 0;
+	long next_run = 0;
+	long next_write = 0;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::vector<std::thread> threads;
+	for (int ti=0;ti<parallelism;ti++) {
+		threads.emplace_back([&](){
+			char * raw = (char *)malloc(run_bytes);
+			std::vector<Edge> edges;
+			std::vector<char> frames;
+			long k;
+			while ((k = __sync_fetch_and_add(&next_run, 1)) < (long)runs.size()) {
+				int ij;
+				long begin, end;
+				std::tie(ij, begin, end) = runs[k];
+				long bytes = pread(fin, raw, end - begin, begin);
+				assert(bytes==end - begin);
+				long count = bytes / edge_unit;
+				edges.resize(count);
+				for (long e=0;e<count;e++) {
+					edges[e].source = *(VertexId*)(raw+e*edge_unit);
+					edges[e].target = *(VertexId*)(raw+e*edge_unit+sizeof(VertexId));
+					edges[e].weight = weighted ? *(Weight*)(raw+e*edge_unit+sizeof(VertexId)*2) : 0;
+				}
+				std::sort(edges.begin(), edges.end(), [](const Edge & a, const Edge & b){
+					return a.source < b.source || (a.source==b.source && a.target < b.target);
+				});
+				frames.clear();
+				for (long e=0;e<count;) {
+					frames.resize(frames.size() + FRAME_SIZE);
+					e += encode_frame(edges.data()+e, count-e, weighted, frames.data()+frames.size()-FRAME_SIZE);
+				}
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&]{ return next_write==k; });
+				for (;next_block<=ij;next_block++) {
+					row_offset[next_block] = write_offset;
+				}
+				bytes = pwrite(fout, frames.data(), frames.size(), write_offset);
+				assert(bytes==(long)frames.size());
+				write_offset += frames.size();
+				next_write++;
+				cond.notify_all();
+			}
+			free(raw);
+		});
+	}
+	for (int ti=0;ti<parallelism;ti++) {
+		threads[ti].join();
+	}
+	for (;next_block<=blocks;next_block++) {
+		row_offset[next_block] = write_offset;
+	}
+	close(fout);
+	close(fin);
+	int ret = rename((output+"/row.compressed").c_str(), (output+"/row").c_str());
+	assert(ret==0);
+	printf("compressed %ld bytes of edges into %ld bytes (%.2fx)\n", raw_offset[blocks], row_offset[blocks], (double)raw_offset[blocks] / std::max(row_offset[blocks], 1l));
 
-	long offset;
-	int fout_column = open((output+"/column").c_str(), O_WRONLY|O_APPEND|O_CREAT, 0644);
-	int fout_column_offset = open((output+"/column_offset").c_str(), O_WRONLY|O_APPEND|O_CREAT, 0644);
-	offset = 0;
+	long * column_offset = new long [blocks+1];
+	column_offset[0] = 0;
+	fin = open((output+"/row").c_str(), O_RDONLY);
+	fout = open((output+"/column").c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	assert(fin!=-1 && fout!=-1);
+	char * buffer = NULL;
 	for (int j=0;j<partitions;j++) {
 		for (int i=0;i<partitions;i++) {
-			printf("progress: %.2f%%\r", 100. * offset / total_bytes);
-			fflush(stdout);
-			write(fout_column_offset, &offset, sizeof(offset));
-			char filename[4096];
-			sprintf(filename, "%s/block-%d-%d", output.c_str(), i, j);
-			offset += file_size(filename);
-			fin = open(filename, O_RDONLY);
-			while (true) {
-				long bytes = read(fin, buffers[0], IOSIZE);
-				assert(bytes!=-1);
-				if (bytes==0) break;
-				write(fout_column, buffers[0], bytes);
+			int ij = i*partitions+j;
+			int ji = j*partitions+i;
+			long length = row_offset[ij+1] - row_offset[ij];
+			column_offset[ji+1] = column_offset[ji] + length;
+			loff_t offset_in = row_offset[ij];
+			loff_t offset_out = column_offset[ji];
+			while (length > 0 && buffer==NULL) {
+				ssize_t copied = copy_file_range(fin, &offset_in, fout, &offset_out, length, 0);
+				if (copied<=0) {
+					buffer = (char *)malloc(IOSIZE); // not supported here: copy through user space
+					break;
+				}
+				length -= copied;
+			}
+			while (length > 0) {
+				long bytes = pread(fin, buffer, std::min(length, (long)IOSIZE), offset_in);
+				assert(bytes>0);
+				long written = pwrite(fout, buffer, bytes, offset_out);
+				assert(written==bytes);
+				offset_in += bytes;
+				offset_out += bytes;
+				length -= bytes;
 			}
-			close(fin);
 		}
 	}
-	write(fout_column_offset, &offset, sizeof(offset));
-	close(fout_column_offset);
-	close(fout_column);
-	printf("column oriented grid generated\n");
-	int fout_row = open((output+"/row").c_str(), O_WRONLY|O_APPEND|O_CREAT, 0644);
-	int fout_row_offset = open((output+"/row_offset").c_str(), O_WRONLY|O_APPEND|O_CREAT, 0644);
-	offset = 0;
-	for (int i=0;i<partitions;i++) {
-		for (int j=0;j<partitions;j++) {
-			printf("progress: %.2f%%\r", 100. * offset / total_bytes);
-			fflush(stdout);
-			write(fout_row_offset, &offset, sizeof(offset));
-			char filename[4096];
-			sprintf(filename, "%s/block-%d-%d", output.c_str(), i, j);
-			offset += file_size(filename);
-			fin = open(filename, O_RDONLY);
-			while (true) {
-				long bytes = read(fin, buffers[0], IOSIZE);
-				assert(bytes!=-1);
-				if (bytes==0) break;
-				write(fout_row, buffers[0], bytes);
+	free(buffer);
+	close(fout);
+	close(fin);
+	write_offsets(output+"/row_offset", row_offset, blocks);
+	write_offsets(output+"/column_offset", column_offset, blocks);
+	delete [] column_offset;
+	delete [] row_offset;
+	delete [] raw_offset;
+}
+
+// two passes over the input: the first counts the edges of every block, which fixes where each block
+// starts in the row- and column-oriented files; the second buckets every chunk by block and pwrites each
+// bucket into both preallocated files at a range reserved with one atomic add per block
+void generate_edge_grid(std::string input, std::string output, VertexId vertices, int partitions, int edge_type, int queue_type, VertexId * new_id) {
+	int parallelism = std::thread::hardware_concurrency();
+	int edge_unit;
+	EdgeId edges;
+	switch (edge_type) {
+	case 0:
+	case 2:
+		edge_unit = sizeof(VertexId) * 2;
+		edges = file_size(input) / edge_unit;
+		break;
+	case 1:
+	case 3:
+		edge_unit = sizeof(VertexId) * 2 + sizeof(Weight);
+		edges = file_size(input) / edge_unit;
+		break;
+	default:
+		fprintf(stderr, "edge type (%d) is not supported.\n", edge_type);
+		exit(-1);
+	}
+	// compressed grids are encoded from the raw row-oriented grid afterwards (see compress_grid)
+	bool compressed = is_compressed(edge_type);
+	printf("vertices = %ld, edges = %ld\n", (long)vertices, edges);
+
+	char ** buffers = new char * [parallelism*2];
+	char ** local_buffers = new char * [parallelism];
+	for (int i=0;i<parallelism*2;i++) {
+		buffers[i] = (char *)memalign(PAGESIZE, IOSIZE);
+	}
+	for (int i=0;i<parallelism;i++) {
+		local_buffers[i] = (char *)memalign(PAGESIZE, IOSIZE);
+	}
+	if (file_exists(output)) {
+		remove_directory(output);
+	}
+	create_directory(output);
+	if (new_id!=NULL) {
+		// the new id of every input vertex, to map results back to input ids
+		int fout_permutation = open((output+"/permutation").c_str(), O_WRONLY|O_CREAT, 0644);
+		long bytes = write(fout_permutation, new_id, sizeof(VertexId) * vertices);
+		assert(bytes==(long)sizeof(VertexId) * vertices);
+		close(fout_permutation);
+	}
+	auto remap = [&](char * buffer, long bytes){
+		if (new_id==NULL) return;
+		for (long pos=0;pos<bytes;pos+=edge_unit) {
+			VertexId * edge = (VertexId*)(buffer+pos);
+			edge[0] = new_id[edge[0]];
+			edge[1] = new_id[edge[1]];
+		}
+	};
+
+	const int blocks = partitions * partitions;
+	long * block_bytes = new long [blocks]();
+	double start_time = get_time();
+	scan_input(input, parallelism, queue_type, buffers, edge_unit, "counting", [&](int thread_id, char * buffer, long bytes){
+		remap(buffer, bytes);
+		long * local_bytes = new long [blocks]();
+		for (long pos=0;pos<bytes;pos+=edge_unit) {
+			VertexId source = *(VertexId*)(buffer+pos);
+			VertexId target = *(VertexId*)(buffer+pos+sizeof(VertexId));
+			int i = get_partition_id(vertices, partitions, source);
+			int j = get_partition_id(vertices, partitions, target);
+			local_bytes[i*partitions+j] += edge_unit;
+		}
+		for (int ij=0;ij<blocks;ij++) {
+			if (local_bytes[ij]!=0) {
+				write_add(&block_bytes[ij], local_bytes[ij]);
 			}
-			close(fin);
+		}
+		delete [] local_bytes;
+	});
+	printf("it takes %.2f seconds to count edge blocks\n", get_time() - start_time);
+
+	long * row_offset = new long [blocks+1];
+	long * column_offset = new long [blocks+1];
+	long * block_column_start = new long [blocks]; // where block (i,j) starts in the column-oriented file
+	row_offset[0] = 0;
+	for (int ij=0;ij<blocks;ij++) {
+		row_offset[ij+1] = row_offset[ij] + block_bytes[ij];
+	}
+	column_offset[0] = 0;
+	for (int j=0;j<partitions;j++) {
+		for (int i=0;i<partitions;i++) {
+			int ji = j*partitions+i;
+			block_column_start[i*partitions+j] = column_offset[ji];
+			column_offset[ji+1] = column_offset[ji] + block_bytes[i*partitions+j];
+		}
+	}
+	long total_bytes = row_offset[blocks];
+	for (int layout=0;layout<2;layout++) {
+		int fout_offset = open((output+(layout==0?"/column_offset":"/row_offset")).c_str(), O_WRONLY|O_CREAT, 0644);
+		long bytes = write(fout_offset, layout==0?column_offset:row_offset, sizeof(long)*(blocks+1));
+		assert(bytes==(long)sizeof(long)*(blocks+1));
+		close(fout_offset);
+	}
+	int fout_row = open((output+"/row").c_str(), O_WRONLY|O_CREAT, 0644);
+	int fout_column = compressed ? -1 : open((output+"/column").c_str(), O_WRONLY|O_CREAT, 0644);
+	assert(fout_row!=-1 && (compressed || fout_column!=-1));
+	if (total_bytes > 0) {
+		// fall back to a sparse file where the file system cannot preallocate
+		int ret = posix_fallocate(fout_row, 0, total_bytes);
+		if (ret!=0) ret = ftruncate(fout_row, total_bytes);
+		assert(ret==0);
+		if (!compressed) {
+			ret = posix_fallocate(fout_column, 0, total_bytes);
+			if (ret!=0) ret = ftruncate(fout_column, total_bytes);
+			assert(ret==0);
 		}
 	}
-	write(fout_row_offset, &offset, sizeof(offset));
-	close(fout_row_offset);
-	close(fout_row);
-	printf("row oriented grid generated\n");
 
+	long * block_cursor = new long [blocks]; // bytes of block (i,j) reserved so far
+	for (int ij=0;ij<blocks;ij++) {
+		block_cursor[ij] = 0;
+	}
+	scan_input(input, parallelism, queue_type, buffers, edge_unit, "scattering", [&](int thread_id, char * buffer, long bytes){
+		remap(buffer, bytes);
+		char * local_buffer = local_buffers[thread_id];
+		long * local_offset = new long [blocks]();
+		long * local_cursor = new long [blocks];
+		for (long pos=0;pos<bytes;pos+=edge_unit) {
+			VertexId source = *(VertexId*)(buffer+pos);
+			VertexId target = *(VertexId*)(buffer+pos+sizeof(VertexId));
+			int i = get_partition_id(vertices, partitions, source);
+			int j = get_partition_id(vertices, partitions, target);
+			local_offset[i*partitions+j] += edge_unit;
+		}
+		local_cursor[0] = 0;
+		for (int ij=1;ij<blocks;ij++) {
+			local_cursor[ij] = local_offset[ij - 1];
+			local_offset[ij] += local_cursor[ij];
+		}
+		for (long pos=0;pos<bytes;pos+=edge_unit) {
+			VertexId source = *(VertexId*)(buffer+pos);
+			VertexId target = *(VertexId*)(buffer+pos+sizeof(VertexId));
+			int i = get_partition_id(vertices, partitions, source);
+			int j = get_partition_id(vertices, partitions, target);
+			memcpy(local_buffer+local_cursor[i*partitions+j], buffer+pos, edge_unit);
+			local_cursor[i*partitions+j] += edge_unit;
+		}
+		long start = 0;
+		for (int ij=0;ij<blocks;ij++) {
+			long length = local_offset[ij] - start;
+			if (length > 0) {
+				long position = __sync_fetch_and_add(&block_cursor[ij], length);
+				assert(position + length <= block_bytes[ij]);
+				long written = pwrite(fout_row, local_buffer+start, length, row_offset[ij]+position);
+				assert(written==length);
+				if (!compressed) {
+					written = pwrite(fout_column, local_buffer+start, length, block_column_start[ij]+position);
+					assert(written==length);
+				}
+			}
+			start = local_offset[ij];
+		}
+		delete [] local_cursor;
+		delete [] local_offset;
+	});
+	for (int ij=0;ij<blocks;ij++) {
+		assert(block_cursor[ij]==block_bytes[ij]);
+	}
+	if (!compressed) {
+		close(fout_column);
+	}
+	close(fout_row);
+	if (compressed) {
+		compress_grid(output, partitions, edge_type);
+	}
 	printf("it takes %.2f seconds to generate edge grid\n", get_time() - start_time);
 
 	FILE * fmeta = fopen((output+"/meta").c_str(), "w");
-	fprintf(fmeta, "%d %d %ld %d", edge_type, vertices, edges, partitions);
+	fprintf(fmeta, "%d %ld %ld %d %d", edge_type, (long)vertices, edges, partitions, (int)sizeof(VertexId));
 	fclose(fmeta);
+
+	for (int i=0;i<parallelism*2;i++) {
+		free(buffers[i]);
+	}
+	for (int i=0;i<parallelism;i++) {
+		free(local_buffers[i]);
+	}
+	delete [] buffers;
+	delete [] local_buffers;
+	delete [] block_cursor;
+	delete [] block_column_start;
+	delete [] column_offset;
+	delete [] row_offset;
+	delete [] block_bytes;
 }
 
 int main(int argc, char ** argv) {
@@ -274,7 +683,9 @@ int main(int argc, char ** argv) {
 	VertexId vertices = -1;
 	int partitions = -1;
 	int edge_type = 0;
-	while ((opt = getopt(argc, argv, "i:o:v:p:t:")) != -1) {
+	int queue_type = QUEUE_LOCKFREE;
+	int ordering = ORDER_NONE;
+	while ((opt = getopt(argc, argv, "i:o:v:p:t:q:r:")) != -1) {
 		switch (opt) {
 		case 'i':
 			input = optarg;
@@ -283,7 +694,7 @@ int main(int argc, char ** argv) {
 			output = optarg;
 			break;
 		case 'v':
-			vertices = atoi(optarg);
+			vertices = atol(optarg);
 			break;
 		case 'p':
 			partitions = atoi(optarg);
@@ -291,15 +702,26 @@ int main(int argc, char ** argv) {
 		case 't':
 			edge_type = atoi(optarg);
 			break;
+		case 'q':
+			queue_type = atoi(optarg);
+			break;
+		case 'r':
+			ordering = atoi(optarg);
+			break;
 		}
 	}
 	if (input=="" || output=="" || vertices==-1) {
-		fprintf(stderr, "usage: %s -i [input path] -o [output path] -v [vertices] -p [partitions] -t [edge type: 0=unweighted, 1=weighted]\n", argv[0]);
+		fprintf(stderr, "usage: %s -i [input path] -o [output path] -v [vertices] -p [partitions] -t [edge type: 0=unweighted, 1=weighted, 2=compressed unweighted, 3=compressed weighted] -q [task queue: 0=mutex, 1=lock-free] -r [vertex order: 0=input, 1=degree, 2=rcm, 3=gorder]\n", argv[0]);
 		exit(-1);
 	}
 	if (partitions==-1) {
 		partitions = vertices / CHUNKSIZE;
 	}
-	generate_edge_grid(input, output, vertices, partitions, edge_type);
+	VertexId * new_id = NULL;
+	if (ordering!=ORDER_NONE) {
+		new_id = relabel(input, vertices, edge_type, ordering);
+	}
+	generate_edge_grid(input, output, vertices, partitions, edge_type, queue_type, new_id);
+	delete [] new_id;
 	return 0;
 }